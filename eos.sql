@@ -24,6 +24,22 @@ CREATE DATABASE `eos` DEFAULT CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci;
 
 USE eos;
 
+--
+-- Table structure for table `abi_history`
+--
+
+DROP TABLE IF EXISTS `abi_history`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `abi_history` (
+  `account` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `abi_bin` mediumblob NOT NULL,
+  `created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`account`,`block_num`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `accounts`
 --
@@ -35,6 +51,7 @@ CREATE TABLE `accounts` (
   `id` bigint(20) NOT NULL AUTO_INCREMENT,
   `name` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `abi` json DEFAULT NULL,
+  `abi_block_num` bigint(20) NOT NULL DEFAULT '0',
   `created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
   `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
   PRIMARY KEY (`id`),
@@ -75,12 +92,17 @@ CREATE TABLE `actions` (
   `name` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
   `data` json DEFAULT NULL,
+  `data_raw` mediumblob,
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
   `eosto` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `eosfrom` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `receiver` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `payer` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `newaccount` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `sellram_account` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `global_sequence` bigint(20) unsigned DEFAULT NULL,
+  `depth` tinyint(3) unsigned NOT NULL DEFAULT '0',
+  `decoded` tinyint(1) NOT NULL DEFAULT '1',
   PRIMARY KEY (`id`),
   KEY `idx_actions_account` (`account`),
   KEY `idx_actions_name` (`name`),
@@ -91,7 +113,10 @@ CREATE TABLE `actions` (
   KEY `idx_actions_receiver` (`receiver`),
   KEY `idx_actions_payer` (`payer`),
   KEY `idx_actions_newaccount` (`newaccount`),
-  KEY `idx_actions_sellram_account` (`sellram_account`)
+  KEY `idx_actions_sellram_account` (`sellram_account`),
+  KEY `idx_actions_parent` (`parent`),
+  KEY `idx_actions_global_sequence` (`global_sequence`),
+  KEY `idx_actions_decoded` (`decoded`,`id`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
@@ -107,6 +132,7 @@ CREATE TABLE `actions_accounts` (
   `actor` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `permission` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `action_id` bigint(20) NOT NULL DEFAULT '0',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
   PRIMARY KEY (`id`),
   KEY `idx_actions_actor` (`actor`),
   KEY `idx_actions_action_id` (`action_id`)
@@ -134,6 +160,23 @@ CREATE TABLE `assets` (
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `backfill_ranges`
+--
+
+DROP TABLE IF EXISTS `backfill_ranges`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `backfill_ranges` (
+  `pass` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `first_block` bigint(20) NOT NULL DEFAULT '0',
+  `last_block` bigint(20) NOT NULL DEFAULT '0',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+  PRIMARY KEY (`pass`,`first_block`,`last_block`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `blocks`
 --
@@ -162,6 +205,58 @@ CREATE TABLE `blocks` (
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `hourly_contracts`
+--
+
+DROP TABLE IF EXISTS `hourly_contracts`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `hourly_contracts` (
+  `contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `hour` datetime NOT NULL,
+  `actions` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`hour`),
+  KEY `idx_hourly_contracts_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `hourly_producers`
+--
+
+DROP TABLE IF EXISTS `hourly_producers`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `hourly_producers` (
+  `producer` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `hour` datetime NOT NULL,
+  `blocks` bigint(20) unsigned NOT NULL DEFAULT '0',
+  `transactions` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`producer`,`hour`),
+  KEY `idx_hourly_producers_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `hourly_transfers`
+--
+
+DROP TABLE IF EXISTS `hourly_transfers`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `hourly_transfers` (
+  `contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `symbol` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',
+  `hour` datetime NOT NULL,
+  `transfers` bigint(20) unsigned NOT NULL DEFAULT '0',
+  `volume` decimal(38,0) NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol`,`symbol_precision`,`hour`),
+  KEY `idx_hourly_transfers_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `refunds`
 --
@@ -180,6 +275,33 @@ CREATE TABLE `refunds` (
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `reversible_blocks`
+--
+
+DROP TABLE IF EXISTS `reversible_blocks`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `reversible_blocks` (
+  `id` bigint(20) NOT NULL AUTO_INCREMENT,
+  `block_id` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `block_number` bigint(20) NOT NULL DEFAULT '0',
+  `prev_block_id` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `irreversible` tinyint(1) NOT NULL DEFAULT '0',
+  `timestamp` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  `transaction_merkle_root` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `action_merkle_root` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `producer` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `version` int(11) NOT NULL DEFAULT '0',
+  `new_producers` json DEFAULT NULL,
+  `num_transactions` int(11) NOT NULL DEFAULT '0',
+  `confirmed` int(11) NOT NULL DEFAULT '0',
+  PRIMARY KEY (`id`),
+  UNIQUE KEY `idx_reversible_block_id` (`block_id`),
+  KEY `idx_reversible_block_number` (`block_number`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `stakes`
 --
@@ -199,6 +321,57 @@ CREATE TABLE `stakes` (
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `sync_state`
+--
+
+DROP TABLE IF EXISTS `sync_state`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `sync_state` (
+  `id` tinyint(4) NOT NULL,
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `block_id` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+  PRIMARY KEY (`id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `token_balances`
+--
+
+DROP TABLE IF EXISTS `token_balances`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `token_balances` (
+  `contract` bigint(20) unsigned NOT NULL,
+  `symbol_code` bigint(20) unsigned NOT NULL,
+  `account` bigint(20) unsigned NOT NULL,
+  `amount` bigint(20) NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol_code`,`account`),
+  KEY `idx_token_balances_account` (`account`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `token_supplies`
+--
+
+DROP TABLE IF EXISTS `token_supplies`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `token_supplies` (
+  `contract` bigint(20) unsigned NOT NULL,
+  `symbol_code` bigint(20) unsigned NOT NULL,
+  `symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',
+  `supply` bigint(20) NOT NULL DEFAULT '0',
+  `max_supply` bigint(20) NOT NULL DEFAULT '0',
+  `issuer` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol_code`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Table structure for table `tokens`
 --
@@ -230,7 +403,9 @@ CREATE TABLE `traces` (
   `tx_id` bigint(20) NOT NULL AUTO_INCREMENT,
   `id` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
   `data` json DEFAULT NULL,
+  `data_bin` longblob,
   `irreversible` tinyint(1) NOT NULL DEFAULT '0',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
   PRIMARY KEY (`tx_id`),
   UNIQUE KEY `idx_transactions_id` (`id`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
@@ -255,9 +430,30 @@ CREATE TABLE `transactions` (
   `num_actions` bigint(20) NOT NULL DEFAULT '0',
   `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
   `irreversible` tinyint(1) NOT NULL DEFAULT '0',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `status` tinyint(3) unsigned DEFAULT NULL,
+  `cpu_usage_us` int(10) unsigned DEFAULT NULL,
+  `net_usage_words` int(10) unsigned DEFAULT NULL,
+  `elapsed` bigint(20) DEFAULT NULL,
   PRIMARY KEY (`tx_id`),
   UNIQUE KEY `idx_transactions_id` (`id`),
-  KEY `transactions_block_id` (`block_id`)
+  KEY `transactions_block_id` (`block_id`),
+  KEY `idx_transactions_block_num` (`block_num`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `voter_producers`
+--
+
+DROP TABLE IF EXISTS `voter_producers`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+ SET character_set_client = utf8mb4 ;
+CREATE TABLE `voter_producers` (
+  `voter` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `producer` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  PRIMARY KEY (`voter`,`producer`),
+  KEY `idx_voter_producers_producer` (`producer`)
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
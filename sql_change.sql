@@ -61,4 +61,139 @@ CREATE TABLE `traces` (
   PRIMARY KEY (`tx_id`),
   UNIQUE KEY `idx_transactions_id` (`id`)
 ) ENGINE=InnoDB AUTO_INCREMENT=80164 DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
-/*!40101 SET character_set_client = @saved_cs_client */;
\ No newline at end of file
+/*!40101 SET character_set_client = @saved_cs_client */;
+CREATE TABLE IF NOT EXISTS `reversible_blocks` LIKE `blocks`;
+ALTER TABLE `reversible_blocks` ADD KEY `idx_reversible_block_number` (`block_number`);
+
+CREATE TABLE IF NOT EXISTS `sync_state` (
+  `id` tinyint(4) NOT NULL,
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `block_id` varchar(64) CHARACTER SET utf8mb4 COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',
+  `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+  PRIMARY KEY (`id`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
+
+ALTER TABLE `traces` ADD COLUMN `data_bin` longblob AFTER `data`;
+
+ALTER TABLE `actions` ADD COLUMN `data_raw` mediumblob AFTER `data`, ADD COLUMN `block_num` bigint(20) NOT NULL DEFAULT '0' AFTER `data_raw`;
+ALTER TABLE `accounts` ADD COLUMN `abi_block_num` bigint(20) NOT NULL DEFAULT '0' AFTER `abi`;
+
+CREATE TABLE IF NOT EXISTS `abi_history` (
+  `account` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `abi_bin` mediumblob NOT NULL,
+  `created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (`account`,`block_num`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+ALTER TABLE `actions_accounts` ADD COLUMN `block_num` bigint(20) NOT NULL DEFAULT '0' AFTER `action_id`;
+ALTER TABLE `transactions` ADD COLUMN `block_num` bigint(20) NOT NULL DEFAULT '0' AFTER `irreversible`;
+
+CREATE TABLE IF NOT EXISTS `hourly_contracts` (
+  `contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `hour` datetime NOT NULL,
+  `actions` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`hour`),
+  KEY `idx_hourly_contracts_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+CREATE TABLE IF NOT EXISTS `hourly_producers` (
+  `producer` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `hour` datetime NOT NULL,
+  `blocks` bigint(20) unsigned NOT NULL DEFAULT '0',
+  `transactions` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`producer`,`hour`),
+  KEY `idx_hourly_producers_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+CREATE TABLE IF NOT EXISTS `hourly_transfers` (
+  `contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `symbol` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',
+  `hour` datetime NOT NULL,
+  `transfers` bigint(20) unsigned NOT NULL DEFAULT '0',
+  `volume` decimal(38,0) NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol`,`symbol_precision`,`hour`),
+  KEY `idx_hourly_transfers_hour` (`hour`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- resource usage of irreversible transactions: status as in transaction_receipt_header (0 executed, 1 soft_fail,
+-- 2 hard_fail, 3 delayed, 4 expired), elapsed in microseconds from the trace
+ALTER TABLE `transactions` ADD COLUMN `status` tinyint(3) unsigned DEFAULT NULL AFTER `block_num`,
+  ADD COLUMN `cpu_usage_us` int(10) unsigned DEFAULT NULL AFTER `status`,
+  ADD COLUMN `net_usage_words` int(10) unsigned DEFAULT NULL AFTER `cpu_usage_us`,
+  ADD COLUMN `elapsed` bigint(20) DEFAULT NULL AFTER `net_usage_words`,
+  ADD KEY `idx_transactions_block_num` (`block_num`);
+
+-- position of an action in its trace tree: parent is the parent action's global_sequence (0 for
+-- top level actions), depth 0 at the top. Rows written without a trace leave both unset
+ALTER TABLE `actions` ADD COLUMN `global_sequence` bigint(20) unsigned DEFAULT NULL AFTER `sellram_account`,
+  ADD COLUMN `depth` tinyint(3) unsigned NOT NULL DEFAULT '0' AFTER `global_sequence`,
+  ADD KEY `idx_actions_parent` (`parent`),
+  ADD KEY `idx_actions_global_sequence` (`global_sequence`);
+
+-- for sql_db-token-schema = compact: names and symbol codes as their 64 bit values, amounts in the
+-- token's smallest unit (symbol_precision decimals)
+CREATE TABLE IF NOT EXISTS `token_supplies` (
+  `contract` bigint(20) unsigned NOT NULL,
+  `symbol_code` bigint(20) unsigned NOT NULL,
+  `symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',
+  `supply` bigint(20) NOT NULL DEFAULT '0',
+  `max_supply` bigint(20) NOT NULL DEFAULT '0',
+  `issuer` bigint(20) unsigned NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol_code`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+CREATE TABLE IF NOT EXISTS `token_balances` (
+  `contract` bigint(20) unsigned NOT NULL,
+  `symbol_code` bigint(20) unsigned NOT NULL,
+  `account` bigint(20) unsigned NOT NULL,
+  `amount` bigint(20) NOT NULL DEFAULT '0',
+  PRIMARY KEY (`contract`,`symbol_code`,`account`),
+  KEY `idx_token_balances_account` (`account`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- one row per voter and producer voted for, kept alongside votes.producers. Fill it once from the votes
+-- written so far (MySQL 8), after that voteproducer keeps it up to date
+CREATE TABLE IF NOT EXISTS `voter_producers` (
+  `voter` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `producer` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  PRIMARY KEY (`voter`,`producer`),
+  KEY `idx_voter_producers_producer` (`producer`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+INSERT IGNORE INTO `voter_producers`(`voter`, `producer`)
+  SELECT v.`voter`, p.`producer` FROM `votes` v,
+    JSON_TABLE(v.`producers`, '$[*]' COLUMNS (`producer` varchar(16) PATH '$')) p;
+
+-- block a staged trace was applied in, a fork switch removes the traces of the blocks it drops by it
+ALTER TABLE `traces` ADD COLUMN `block_num` bigint(20) NOT NULL DEFAULT '0' AFTER `irreversible`;
+
+-- rows left for the lazy decoder, which scans them by this index instead of walking ids
+ALTER TABLE `actions` ADD COLUMN `decoded` tinyint(1) NOT NULL DEFAULT '1' AFTER `depth`, ADD KEY `idx_actions_decoded` (`decoded`,`id`);
+UPDATE `actions` SET `decoded` = 0 WHERE `data` IS NULL AND `data_raw` IS NOT NULL;
+
+-- sql_db_backfill progress, one row per range and pass
+CREATE TABLE IF NOT EXISTS `backfill_ranges` (
+  `pass` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',
+  `first_block` bigint(20) NOT NULL DEFAULT '0',
+  `last_block` bigint(20) NOT NULL DEFAULT '0',
+  `block_num` bigint(20) NOT NULL DEFAULT '0',
+  `updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,
+  PRIMARY KEY (`pass`,`first_block`,`last_block`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;
+
+-- Optional, for sql_db-partition-blocks: partition by block_num (here 1000000 blocks per partition).
+-- The plugin never creates these tables, run this before starting with the option set to the same size.
+-- Rows written before block_num existed hold 0 and would sit in the first partition, so fill it first.
+-- UPDATE `transactions` t JOIN `blocks` b ON b.`block_id` = t.`block_id` SET t.`block_num` = b.`block_number` WHERE t.`block_num` = 0;
+-- UPDATE `actions` a JOIN `transactions` t ON t.`id` = a.`transaction_id` SET a.`block_num` = t.`block_num` WHERE a.`block_num` = 0;
+-- UPDATE `actions_accounts` aa JOIN `actions` a ON a.`id` = aa.`action_id` SET aa.`block_num` = a.`block_num` WHERE aa.`block_num` = 0;
+-- Rebuilds the tables; the partitioning column has to be part of every unique key.
+-- ALTER TABLE `actions` DROP PRIMARY KEY, ADD PRIMARY KEY (`id`,`block_num`)
+--   PARTITION BY RANGE (`block_num`) (PARTITION p1000000 VALUES LESS THAN (1000000), PARTITION pmax VALUES LESS THAN MAXVALUE);
+-- ALTER TABLE `actions_accounts` DROP PRIMARY KEY, ADD PRIMARY KEY (`id`,`block_num`)
+--   PARTITION BY RANGE (`block_num`) (PARTITION p1000000 VALUES LESS THAN (1000000), PARTITION pmax VALUES LESS THAN MAXVALUE);
+-- ALTER TABLE `transactions` DROP PRIMARY KEY, ADD PRIMARY KEY (`tx_id`,`block_num`),
+--   DROP INDEX `idx_transactions_id`, ADD UNIQUE KEY `idx_transactions_id` (`id`,`block_num`)
+--   PARTITION BY RANGE (`block_num`) (PARTITION p1000000 VALUES LESS THAN (1000000), PARTITION pmax VALUES LESS THAN MAXVALUE);
@@ -0,0 +1,258 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Offline backfill: reads a local blocks.log and writes block ranges in parallel
+ *  through the same database/table code the plugin uses. Account effects (newaccount,
+ *  setabi) go first, in one ordered pass; each range's progress is kept in backfill_ranges.
+ */
+#include <eosio/sql_db_plugin/database.hpp>
+
+#include <eosio/chain/block_log.hpp>
+
+#include <fc/log/logger.hpp>
+#include <fc/exception/exception.hpp>
+
+#include <boost/program_options.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace bpo = boost::program_options;
+using namespace eosio;
+
+namespace {
+
+struct block_range {
+    uint32_t first = 0;
+    uint32_t last = 0;
+};
+
+// blocks.log opened once; its reads seek a shared stream, so they take turns
+class shared_block_log {
+    public:
+        explicit shared_block_log( const fc::path& blocks_dir ) : m_log(blocks_dir) {}
+
+        chain::signed_block_ptr read_block_by_num( uint32_t num ) {
+            boost::mutex::scoped_lock lock(m_mtx);
+            return m_log.read_block_by_num(num);
+        }
+        chain::signed_block_ptr head() {
+            boost::mutex::scoped_lock lock(m_mtx);
+            return m_log.head();
+        }
+
+    private:
+        boost::mutex m_mtx;
+        chain::block_log m_log;
+};
+
+// splits [first, last] into ranges of `range_size` blocks, fixed by the block numbers alone so a rerun
+// with another worker count finds the same ranges in backfill_ranges
+std::vector<block_range> split_range( uint32_t first, uint32_t last, uint32_t range_size ) {
+    std::vector<block_range> ranges;
+    for( uint64_t begin = first; begin <= last; ) {
+        const uint64_t end = std::min<uint64_t>( (begin / range_size + 1) * range_size - 1, last );
+        ranges.push_back( block_range{ uint32_t(begin), uint32_t(end) } );
+        begin = end + 1;
+    }
+    return ranges;
+}
+
+// writes what is left of `range` in batches; `write` commits one batch with the range's progress
+template<typename Write>
+bool run_range( database& db, shared_block_log& log, const backfill_range& range, uint32_t batch_size,
+                boost::atomic<uint64_t>& written, Write&& write ) {
+    const auto done = db.backfill_progress(range);
+    if( done >= range.last ) {
+        ilog( "${p} ${f}-${l} already done", ("p", range.pass)("f", range.first)("l", range.last) );
+        written += range.last - range.first + 1;
+        return true;
+    }
+    const uint32_t resume = std::max( range.first, done + 1 );
+    written += resume - range.first;
+
+    std::vector<chain::signed_block_ptr> batch;
+    batch.reserve(batch_size);
+    for( uint32_t num = resume; num <= range.last; ++num ) {
+        auto block = log.read_block_by_num(num);
+        if( !block ) {
+            elog( "block ${n} not found in blocks.log", ("n", num) );
+            return false;
+        }
+        batch.emplace_back( std::move(block) );
+        if( batch.size() == batch_size || num == range.last ) {
+            write(batch);
+            written += batch.size();
+            batch.clear();
+        }
+    }
+    ilog( "${p} ${f}-${l} done", ("p", range.pass)("f", range.first)("l", range.last) );
+    return true;
+}
+
+// the ranges after `next` one at a time, until all are taken or one fails
+bool run_worker( const std::string& uri, shared_block_log& log, const std::vector<block_range>& ranges,
+                 boost::atomic<size_t>& next, uint32_t batch_size, bool with_staged_traces, boost::atomic<uint64_t>& written ) {
+    for( size_t i = next++; i < ranges.size(); i = next++ ) {
+        const backfill_range range{ "blocks", ranges[i].first, ranges[i].last };
+        try {
+            database db(uri, range.first);
+            // with staged traces there is one worker, it applies every effect in block order itself
+            db.set_account_effects( with_staged_traces );
+            const bool ok = run_range( db, log, range, batch_size, written, [&]( const std::vector<chain::signed_block_ptr>& batch ) {
+                db.consume_signed_blocks(batch, with_staged_traces, range);
+            });
+            if( ok ) continue;
+        } catch( fc::exception& e ) {
+            elog( "range ${f}-${l} failed: ${e}", ("f", range.first)("l", range.last)("e", e.to_detail_string()) );
+        } catch( std::exception& e ) {
+            elog( "range ${f}-${l} failed: ${e}", ("f", range.first)("l", range.last)("e", e.what()) );
+        }
+        return false;
+    }
+    return true;
+}
+
+// newaccount and setabi in block order, before the parallel pass decodes with the ABIs they set
+bool run_account_pass( const std::string& uri, shared_block_log& log, const std::vector<block_range>& ranges, uint32_t batch_size ) {
+    boost::atomic<uint64_t> written{0};
+    try {
+        database db(uri, ranges.front().first);
+        for( const auto& r : ranges ) {
+            const backfill_range range{ "accounts", r.first, r.last };
+            const bool ok = run_range( db, log, range, batch_size, written, [&]( const std::vector<chain::signed_block_ptr>& batch ) {
+                db.consume_account_effects(batch, range);
+            });
+            if( !ok ) return false;
+        }
+        return true;
+    } catch( fc::exception& e ) {
+        elog( "account pass failed after ${n} blocks: ${e}", ("n", written.load())("e", e.to_detail_string()) );
+    } catch( std::exception& e ) {
+        elog( "account pass failed after ${n} blocks: ${e}", ("n", written.load())("e", e.what()) );
+    }
+    return false;
+}
+
+} // namespace
+
+int main( int argc, char** argv ) {
+    bpo::options_description desc("sql_db_backfill options");
+    desc.add_options()
+        ("help,h", "Print this help message and exit.")
+        ("blocks-dir", bpo::value<std::string>()->default_value("blocks"), "Directory containing blocks.log and blocks.index.")
+        ("sql_db-uri", bpo::value<std::string>(), "Sql DB URI connection string.")
+        ("start", bpo::value<uint32_t>()->default_value(1), "First block to write.")
+        ("end", bpo::value<uint32_t>()->default_value(0), "Last block to write, 0 for the head of blocks.log.")
+        ("workers", bpo::value<uint32_t>()->default_value(boost::thread::hardware_concurrency()), "Number of parallel writers, each with its own connection, taking block ranges in turn.")
+        ("range-size", bpo::value<uint32_t>()->default_value(100000), "Blocks per range. Ranges are aligned to multiples of it, a rerun skips the ranges already done.")
+        ("batch-size", bpo::value<uint32_t>()->default_value(100), "Blocks committed per SQL transaction.")
+        ("staged-traces", bpo::bool_switch()->default_value(false),
+         "Also consume traces previously staged in the traces table. Their balance side effects are order dependent, so this forces a single worker.")
+        ;
+
+    bpo::variables_map vm;
+    try {
+        bpo::store( bpo::parse_command_line(argc, argv, desc), vm );
+        bpo::notify(vm);
+    } catch( const bpo::error& e ) {
+        std::cerr << e.what() << std::endl << desc << std::endl;
+        return 1;
+    }
+
+    if( vm.count("help") || !vm.count("sql_db-uri") ) {
+        std::cout << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+
+    const auto uri = vm["sql_db-uri"].as<std::string>();
+    const fc::path blocks_dir = vm["blocks-dir"].as<std::string>();
+    const bool with_staged_traces = vm["staged-traces"].as<bool>();
+    const uint32_t batch_size = std::max<uint32_t>(1, vm["batch-size"].as<uint32_t>());
+    const uint32_t range_size = std::max<uint32_t>(1, vm["range-size"].as<uint32_t>());
+    uint32_t workers = std::max<uint32_t>(1, vm["workers"].as<uint32_t>());
+    uint32_t first = std::max<uint32_t>(1, vm["start"].as<uint32_t>());
+    uint32_t last = vm["end"].as<uint32_t>();
+
+    std::unique_ptr<shared_block_log> log;
+    chain::signed_block_ptr head;
+    try {
+        log = std::make_unique<shared_block_log>(blocks_dir);
+        head = log->head();
+    } catch( fc::exception& e ) {
+        elog( "unable to open blocks.log in ${d}: ${e}", ("d", blocks_dir.generic_string())("e", e.to_detail_string()) );
+        return 1;
+    }
+    if( !head ) {
+        elog( "blocks.log in ${d} is empty", ("d", blocks_dir.generic_string()) );
+        return 1;
+    }
+    if( last == 0 || last > head->block_num() ) last = head->block_num();
+    if( first > last ) {
+        elog( "nothing to do, start ${f} is past end ${l}", ("f", first)("l", last) );
+        return 1;
+    }
+    if( with_staged_traces && workers > 1 ) {
+        wlog( "staged traces requested, using a single worker" );
+        workers = 1;
+    }
+
+    const auto ranges = split_range(first, last, range_size);
+    workers = std::min<uint32_t>( workers, ranges.size() );
+
+    // with staged traces the single worker applies them in order along with everything else
+    if( !with_staged_traces ) {
+        ilog( "applying account effects of blocks ${f}-${l}", ("f", first)("l", last) );
+        if( !run_account_pass(uri, *log, ranges, batch_size) ) {
+            elog( "backfill incomplete, rerun to resume the account pass" );
+            return 1;
+        }
+    }
+
+    ilog( "backfilling blocks ${f}-${l} in ${r} ranges with ${w} workers", ("f", first)("l", last)("r", ranges.size())("w", workers) );
+
+    boost::atomic<uint64_t> written{0};
+    boost::atomic<uint32_t> finished{0};
+    boost::atomic<size_t> next{0};
+    std::vector<char> results(workers, 0);
+    boost::thread_group threads;
+    for( uint32_t i = 0; i < workers; ++i ) {
+        threads.create_thread( [&, i]() {
+            results[i] = run_worker(uri, *log, ranges, next, batch_size, with_staged_traces, written);
+            ++finished;
+        });
+    }
+
+    const auto started = fc::time_point::now();
+    const uint64_t total = uint64_t(last) - first + 1;
+    for( uint32_t tick = 1; finished < workers; ++tick ) {
+        boost::this_thread::sleep_for( boost::chrono::seconds(1) );
+        if( tick % 10 == 0 ) {
+            auto elapsed = (fc::time_point::now() - started).count() / 1000000.0;
+            ilog( "${w}/${t} blocks, ${r} blocks/s", ("w", written.load())("t", total)("r", uint64_t(written / elapsed)) );
+        }
+    }
+    threads.join_all();
+
+    if( std::find(results.begin(), results.end(), 0) != results.end() ) {
+        elog( "backfill incomplete, rerun to resume the ranges not done" );
+        return 1;
+    }
+
+    // the checkpoint only advances when the backfilled range continues the committed history
+    database db(uri, first);
+    auto checkpoint_block_num = db.last_checkpoint();
+    if( first <= checkpoint_block_num + 1 && last > checkpoint_block_num ) {
+        auto last_block = log->read_block_by_num(last);
+        db.checkpoint(last, last_block->id().str());
+    }
+
+    ilog( "backfill of blocks ${f}-${l} complete", ("f", first)("l", last) );
+    return 0;
+}
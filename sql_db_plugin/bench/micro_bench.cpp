@@ -0,0 +1,226 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Micro benchmarks for the CPU-bound helpers of the writers: ABI decode, trace
+ *  (de)serialization, participant extraction and inline trace traversal. They run
+ *  over the action payloads in synthetic/ and need no database. Those were written by
+ *  hand to match the shapes of common mainnet actions (transfers with short and long
+ *  memos, delegatebw, newaccount, ...); they are not captured from a chain.
+ */
+#include <eosio/sql_db_plugin/actions_table.hpp>
+#include <eosio/sql_db_plugin/traces_table.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+
+namespace bench {
+
+using namespace eosio;
+namespace bpo = boost::program_options;
+
+struct fixture_action {
+    std::string label;
+    chain::action act;
+};
+
+struct options {
+    std::string data_dir = SQL_DB_BENCH_DATA;
+    std::string filter;
+    uint32_t min_time_ms = 500;
+    uint32_t inline_depth = 8;
+    fc::microseconds max_serialization_time = fc::microseconds(150*1000);
+};
+
+// keeps the optimizer from discarding benchmark results
+volatile uint64_t sink = 0;
+
+class runner {
+    public:
+        explicit runner( const options& o ) : m_options(o) {}
+
+        // repeats `fn` in growing batches until min_time_ms elapsed, then reports the mean cost per call
+        template<typename F>
+        void run( const std::string& name, F&& fn ) {
+            if( !m_options.filter.empty() && name.find(m_options.filter) == std::string::npos ) return;
+
+            const auto budget = std::chrono::milliseconds(m_options.min_time_ms);
+            uint64_t iterations = 0;
+            uint64_t batch = 1;
+            auto started = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::steady_clock::duration::zero();
+            while( elapsed < budget ) {
+                for( uint64_t i = 0; i < batch; ++i ) fn();
+                iterations += batch;
+                batch *= 2;
+                elapsed = std::chrono::steady_clock::now() - started;
+            }
+
+            const double ns = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+            m_results.emplace_back( fc::mutable_variant_object()
+                ("name", name)
+                ("iterations", iterations)
+                ("ns_per_op", uint64_t(ns))
+                ("ops_per_sec", uint64_t(1e9 / ns)) );
+            std::cerr << name << ": " << uint64_t(ns) << " ns/op" << std::endl;
+        }
+
+        const std::vector<fc::variant>& results() const { return m_results; }
+
+    private:
+        options m_options;
+        std::vector<fc::variant> m_results;
+};
+
+std::vector<fixture_action> load_actions( const std::string& path ) {
+    std::vector<fixture_action> actions;
+    for( const auto& v : fc::json::from_file(path).get_array() ) {
+        actions.push_back( fixture_action{ v["label"].as_string(), v.as<chain::action>() } );
+    }
+    return actions;
+}
+
+// ABI JSON per account, as accounts.abi holds it
+std::map<chain::account_name, std::string> load_abis( const std::string& path ) {
+    std::map<chain::account_name, std::string> abis;
+    for( const auto& entry : fc::json::from_file(path).get_object() ) {
+        abis[chain::name(entry.key())] = fc::json::to_string(entry.value());
+    }
+    return abis;
+}
+
+// the action as applied by its contract, with the notifications to the
+// parties and `depth` levels of nested inline actions below it
+chain::action_trace make_trace( const chain::action& act, uint32_t depth, uint64_t& sequence ) {
+    chain::action_receipt receipt;
+    receipt.receiver = act.account;
+    receipt.global_sequence = ++sequence;
+    chain::action_trace trace( receipt );
+    trace.act = act;
+
+    for( const auto& auth : act.authorization ) {
+        chain::action_receipt notified;
+        notified.receiver = auth.actor;
+        notified.global_sequence = ++sequence;
+        chain::action_trace notification( notified );
+        notification.act = act;
+        trace.inline_traces.emplace_back( std::move(notification) );
+    }
+    if( depth > 0 ) trace.inline_traces.emplace_back( make_trace(act, depth - 1, sequence) );
+    return trace;
+}
+
+chain::transaction_trace make_transaction( const std::vector<fixture_action>& actions, uint32_t depth ) {
+    chain::transaction_trace trace;
+    trace.receipt = chain::transaction_receipt_header( chain::transaction_receipt_header::executed );
+    trace.elapsed = fc::microseconds(420);
+    uint64_t sequence = 0;
+    for( const auto& fixture : actions ) {
+        trace.action_traces.emplace_back( make_trace(fixture.act, depth, sequence) );
+    }
+    trace.id = chain::transaction_id_type::hash( fc::json::to_string(trace) );
+    return trace;
+}
+
+int run( int argc, char** argv ) {
+    options o;
+    bpo::options_description desc("sql_db_micro_bench options");
+    desc.add_options()
+        ("help,h", "Print this help message and exit.")
+        ("data-dir", bpo::value<std::string>(&o.data_dir)->default_value(o.data_dir), "Directory holding actions.json and abis.json, the synthetic payloads by default.")
+        ("filter", bpo::value<std::string>(&o.filter), "Only run benchmarks whose name contains this string.")
+        ("min-time-ms", bpo::value<uint32_t>(&o.min_time_ms)->default_value(o.min_time_ms), "Minimum run time of every benchmark.")
+        ("inline-depth", bpo::value<uint32_t>(&o.inline_depth)->default_value(o.inline_depth), "Nested inline actions below every action of the deep trace.")
+        ;
+
+    bpo::variables_map vm;
+    bpo::store( bpo::parse_command_line(argc, argv, desc), vm );
+    bpo::notify(vm);
+    if( vm.count("help") ) {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+
+    const auto actions = load_actions( o.data_dir + "/actions.json" );
+    const auto abis = load_abis( o.data_dir + "/abis.json" );
+    runner r(o);
+
+    // what abi_cache saves on every action after the first of each ABI version
+    std::map<chain::account_name, abi_version_ptr> versions;
+    for( const auto& abi : abis ) {
+        r.run( "abi_load/" + abi.first.to_string(), [&]() {
+            abi_version version( 1, fc::json::from_string(abi.second).as<chain::abi_def>(), o.max_serialization_time );
+            sink += version.abi.structs.size();
+        });
+        versions[abi.first] = std::make_shared<const abi_version>( 1, fc::json::from_string(abi.second).as<chain::abi_def>(), o.max_serialization_time );
+    }
+
+    for( const auto& fixture : actions ) {
+        const auto& abi = *versions.at(fixture.act.account);
+        system_contract_arg parties;
+        r.run( "decode_data/" + fixture.label, [&]() {
+            sink += actions_table::decode_data( fixture.act, abi, parties ).size();
+        });
+    }
+
+    for( const auto& fixture : actions ) {
+        system_contract_arg parties;
+        const auto json = actions_table::decode_data( fixture.act, *versions.at(fixture.act.account), parties );
+        r.run( "participants/" + fixture.label, [&]() {
+            sink += actions_table::participants(json).to.value;
+        });
+    }
+
+    fc::mutable_variant_object trace_sizes;
+    const std::vector<std::pair<std::string, uint32_t>> shapes = { {"flat", 0}, {"deep", o.inline_depth} };
+    for( const auto& shape : shapes ) {
+        const auto trace = make_transaction( actions, shape.second );
+        const auto data = traces_table::encode(trace);
+        const auto data_bin = traces_table::encode_binary(trace);
+        trace_sizes( shape.first, fc::mutable_variant_object()("json", data.size())("binary", data_bin.size()) );
+
+        r.run( "trace_encode/" + shape.first, [&]() {
+            sink += traces_table::encode(trace).size();
+        });
+        r.run( "trace_decode/" + shape.first, [&]() {
+            sink += traces_table::decode(data).action_traces.size();
+        });
+        r.run( "trace_encode_binary/" + shape.first, [&]() {
+            sink += traces_table::encode_binary(trace).size();
+        });
+        r.run( "trace_decode_binary/" + shape.first, [&]() {
+            sink += traces_table::decode_binary(data_bin).action_traces.size();
+        });
+        r.run( "trace_walk/" + shape.first, [&]() {
+            traces_table::for_each_flattened_action( trace.action_traces, []( const flattened_action& action ) {
+                sink += action.trace.act.data.size() + action.depth;
+            });
+        });
+    }
+
+    std::cout << fc::json::to_pretty_string( fc::mutable_variant_object()
+        ("min_time_ms", o.min_time_ms)
+        ("inline_depth", o.inline_depth)
+        ("trace_bytes", trace_sizes)
+        ("benchmarks", r.results()) ) << std::endl;
+    return 0;
+}
+
+} // namespace bench
+
+int main( int argc, char** argv ) {
+    try {
+        return bench::run(argc, argv);
+    } catch( const fc::exception& e ) {
+        elog( "${e}", ("e", e.to_detail_string()) );
+    } catch( const std::exception& e ) {
+        elog( "${e}", ("e", e.what()) );
+    }
+    return 1;
+}
@@ -0,0 +1,315 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  End-to-end throughput benchmark: feeds synthetic block_state / transaction_trace
+ *  streams through the real consumer and database into a scratch SQL database.
+ */
+#include "consumer.hpp"
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/authority.hpp>
+#include <eosio/chain/contract_types.hpp>
+#include <eosio/chain/eosio_contract.hpp>
+#include <eosio/chain/transaction_metadata.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <random>
+
+namespace bench {
+
+using namespace eosio;
+
+struct transfer {
+    chain::account_name from;
+    chain::account_name to;
+    chain::asset quantity;
+    std::string memo;
+};
+
+struct delegatebw {
+    chain::account_name from;
+    chain::account_name receiver;
+    chain::asset stake_net_quantity;
+    chain::asset stake_cpu_quantity;
+    bool transfer = false;
+};
+
+struct workload {
+    uint32_t blocks = 1000;
+    uint32_t trxs_per_block = 50;
+    uint32_t transfer_weight = 80;
+    uint32_t delegatebw_weight = 15;
+    uint32_t newaccount_weight = 5;
+    uint32_t inline_depth = 0;
+    uint32_t abi_padding = 0;
+    uint32_t irreversible_lag = 2;
+    uint32_t accounts = 1000;
+};
+
+} // namespace bench
+
+FC_REFLECT( bench::transfer, (from)(to)(quantity)(memo) )
+FC_REFLECT( bench::delegatebw, (from)(receiver)(stake_net_quantity)(stake_cpu_quantity)(transfer) )
+
+namespace bench {
+
+namespace bpo = boost::program_options;
+
+const chain::account_name token_account = N(eosio.token);
+
+// deterministic valid account names: "bench" followed by a base-26 suffix
+chain::account_name account( uint32_t index ) {
+    std::string suffix;
+    for( int i = 0; i < 7; ++i ) {
+        suffix.insert( suffix.begin(), char('a' + index % 26) );
+        index /= 26;
+    }
+    return chain::name( "bench" + suffix );
+}
+
+// ABI with the actions the workload uses, padded with unused structs to model large contract ABIs
+chain::abi_def make_abi( bool system, uint32_t padding ) {
+    chain::abi_def abi;
+    if( system ) abi = chain::eosio_contract_abi(abi);
+
+    abi.structs.emplace_back( chain::struct_def{ "transfer", "", {
+        {"from", "account_name"}, {"to", "account_name"}, {"quantity", "asset"}, {"memo", "string"} } } );
+    abi.actions.push_back( chain::action_def{ N(transfer), "transfer", "" } );
+
+    if( system ) {
+        abi.structs.emplace_back( chain::struct_def{ "delegatebw", "", {
+            {"from", "account_name"}, {"receiver", "account_name"},
+            {"stake_net_quantity", "asset"}, {"stake_cpu_quantity", "asset"}, {"transfer", "bool"} } } );
+        abi.actions.push_back( chain::action_def{ N(delegatebw), "delegatebw", "" } );
+    }
+
+    for( uint32_t i = 0; i < padding; ++i ) {
+        abi.structs.emplace_back( chain::struct_def{ "padding" + std::to_string(i), "", {
+            {"owner", "account_name"}, {"balance", "asset"}, {"memo", "string"}, {"values", "uint64[]"} } } );
+    }
+    return abi;
+}
+
+class generator {
+    public:
+        explicit generator( const workload& w ) : m_workload(w), m_rng(42) {}
+
+        struct block {
+            chain::block_state_ptr bs;
+            std::vector<chain::transaction_trace_ptr> traces;
+            uint64_t actions = 0;
+        };
+
+        block next() {
+            block result;
+            auto signed_block = std::make_shared<chain::signed_block>();
+            signed_block->timestamp = chain::block_timestamp_type( fc::time_point::now() );
+            signed_block->producer = N(eosio);
+            // the block number is encoded in the previous id, which starts out as zero for block 1
+            signed_block->previous = m_previous;
+
+            auto bs = std::make_shared<chain::block_state>();
+            for( uint32_t t = 0; t < m_workload.trxs_per_block; ++t ) {
+                chain::signed_transaction trx;
+                trx.expiration = fc::time_point_sec( fc::time_point::now() ) + 30;
+                trx.actions.emplace_back( next_action() );
+
+                chain::packed_transaction packed( trx );
+                auto metadata = std::make_shared<chain::transaction_metadata>( packed );
+                bs->trxs.emplace_back( metadata );
+                signed_block->transactions.emplace_back( packed );
+
+                auto trace = std::make_shared<chain::transaction_trace>();
+                trace->id = metadata->id;
+                trace->receipt = chain::transaction_receipt_header( chain::transaction_receipt_header::executed );
+                for( const auto& act : trx.actions ) {
+                    trace->action_traces.emplace_back( make_trace(act, m_workload.inline_depth, result.actions) );
+                }
+                result.traces.emplace_back( std::move(trace) );
+            }
+
+            bs->block = signed_block;
+            bs->header = *signed_block;
+            bs->id = signed_block->id();
+            bs->block_num = signed_block->block_num();
+            m_previous = bs->id;
+
+            result.bs = bs;
+            return result;
+        }
+
+    private:
+        chain::action next_action() {
+            auto auth = std::vector<chain::permission_level>{ { random_account(), N(active) } };
+            uint32_t total = m_workload.transfer_weight + m_workload.delegatebw_weight + m_workload.newaccount_weight;
+            uint32_t pick = std::uniform_int_distribution<uint32_t>(0, std::max<uint32_t>(total, 1) - 1)(m_rng);
+
+            if( pick < m_workload.transfer_weight ) {
+                transfer t{ auth[0].actor, random_account(), chain::asset(1 + pick), "bench " + std::to_string(m_sequence++) };
+                return chain::action( auth, token_account, N(transfer), fc::raw::pack(t) );
+            }
+            if( pick < m_workload.transfer_weight + m_workload.delegatebw_weight ) {
+                delegatebw d{ auth[0].actor, random_account(), chain::asset(10000), chain::asset(10000 + m_sequence++), false };
+                return chain::action( auth, chain::config::system_account_name, N(delegatebw), fc::raw::pack(d) );
+            }
+
+            chain::newaccount n;
+            n.creator = auth[0].actor;
+            n.name = account( m_workload.accounts + m_sequence++ );
+            n.owner = chain::authority( chain::public_key_type() );
+            n.active = chain::authority( chain::public_key_type() );
+            return chain::action( auth, n );
+        }
+
+        // the action plus `depth` levels of inline token transfers it causes
+        chain::action_trace make_trace( const chain::action& act, uint32_t depth, uint64_t& actions ) {
+            chain::action_receipt receipt;
+            receipt.receiver = act.account;
+            receipt.global_sequence = ++m_global_sequence;
+            chain::action_trace trace( receipt );
+            trace.act = act;
+            ++actions;
+            if( depth > 0 ) {
+                transfer t{ random_account(), random_account(), chain::asset(1), "inline" };
+                auto inline_act = chain::action( std::vector<chain::permission_level>{ { t.from, N(active) } },
+                                                 token_account, N(transfer), fc::raw::pack(t) );
+                trace.inline_traces.emplace_back( make_trace(inline_act, depth - 1, actions) );
+            }
+            return trace;
+        }
+
+        chain::account_name random_account() {
+            return account( std::uniform_int_distribution<uint32_t>(0, m_workload.accounts - 1)(m_rng) );
+        }
+
+        workload m_workload;
+        std::mt19937 m_rng;
+        chain::block_id_type m_previous;
+        uint64_t m_sequence = 0;
+        uint64_t m_global_sequence = 0;
+};
+
+void prepare( const std::string& uri, const workload& w ) {
+    soci::session session(uri);
+    const auto system_abi = fc::json::to_string( make_abi(true, w.abi_padding) );
+    const auto token_abi = fc::json::to_string( make_abi(false, w.abi_padding) );
+    const std::string system_name = "eosio";
+    const std::string token_name = "eosio.token";
+
+    session << "DELETE FROM accounts WHERE name IN ('eosio', 'eosio.token')";
+    session << "INSERT INTO accounts (name, abi) VALUES (:n, :a)", soci::use(system_name), soci::use(system_abi);
+    session << "INSERT INTO accounts (name, abi) VALUES (:n, :a)", soci::use(token_name), soci::use(token_abi);
+}
+
+int run( int argc, char** argv ) {
+    workload w;
+    bpo::options_description desc("sql_db_bench options");
+    desc.add_options()
+        ("help,h", "Print this help message and exit.")
+        ("sql_db-uri", bpo::value<std::string>(), "Scratch database with the eos.sql schema loaded, use a fresh one for every run.")
+        ("blocks", bpo::value<uint32_t>(&w.blocks)->default_value(w.blocks), "Blocks to generate.")
+        ("trxs-per-block", bpo::value<uint32_t>(&w.trxs_per_block)->default_value(w.trxs_per_block), "Transactions per block.")
+        ("transfer-weight", bpo::value<uint32_t>(&w.transfer_weight)->default_value(w.transfer_weight), "Relative share of eosio.token transfers.")
+        ("delegatebw-weight", bpo::value<uint32_t>(&w.delegatebw_weight)->default_value(w.delegatebw_weight), "Relative share of eosio delegatebw.")
+        ("newaccount-weight", bpo::value<uint32_t>(&w.newaccount_weight)->default_value(w.newaccount_weight), "Relative share of eosio newaccount.")
+        ("inline-depth", bpo::value<uint32_t>(&w.inline_depth)->default_value(w.inline_depth), "Nested inline transfers below every action.")
+        ("abi-padding", bpo::value<uint32_t>(&w.abi_padding)->default_value(w.abi_padding), "Unused structs added to each ABI to model large contracts.")
+        ("irreversible-lag", bpo::value<uint32_t>(&w.irreversible_lag)->default_value(w.irreversible_lag), "Blocks between a block being accepted and becoming irreversible.")
+        ("accounts", bpo::value<uint32_t>(&w.accounts)->default_value(w.accounts), "Distinct accounts the workload picks from.")
+        ("queue-size", bpo::value<uint32_t>()->default_value(2000), "Consumer queue size.")
+        ("reversible-buffer", bpo::bool_switch()->default_value(false), "Buffer reversible blocks in memory, as sql_db-reversible-buffer.")
+        ("trace-encoding", bpo::value<std::string>()->default_value("json"), "Staged trace encoding, json or binary, as sql_db-trace-encoding.")
+        ("timeout", bpo::value<uint32_t>()->default_value(600), "Seconds to wait for the last block to be committed before the run is reported as failed.")
+        ;
+
+    bpo::variables_map vm;
+    bpo::store( bpo::parse_command_line(argc, argv, desc), vm );
+    bpo::notify(vm);
+    if( vm.count("help") || !vm.count("sql_db-uri") ) {
+        std::cout << desc << std::endl;
+        return vm.count("help") ? 0 : 1;
+    }
+    w.accounts = std::max<uint32_t>(1, w.accounts);
+
+    const auto uri = vm["sql_db-uri"].as<std::string>();
+    prepare(uri, w);
+
+    auto db = std::make_unique<database>(uri, 0);
+    auto db2 = std::make_unique<database>(uri, 0);
+    auto buffer = std::make_shared<reversible_block_buffer>();
+    bool buffer_blocks = vm["reversible-buffer"].as<bool>();
+    db->set_reversible_buffer(buffer, buffer_blocks, false);
+    db2->set_reversible_buffer(buffer, buffer_blocks, false);
+    const auto encoding = vm["trace-encoding"].as<std::string>() == "binary" ? trace_encoding::binary : trace_encoding::json;
+    db->set_trace_encoding(encoding);
+    db2->set_trace_encoding(encoding);
+
+    consumer handler( std::move(db), std::move(db2), vm["queue-size"].as<uint32_t>(), 0, fc::microseconds(0) );
+    auto& committed = metrics::instance().gauge("irreversible.last_committed");
+    boost::atomic<bool> halted{false};
+    handler.on_irreversible_failure = [&halted]() { halted = true; };
+
+    generator gen(w);
+    std::deque<chain::block_state_ptr> pending;
+    uint64_t actions = 0;
+    uint32_t last_block_num = 0;
+
+    const auto started = fc::time_point::now();
+    for( uint32_t i = 0; i < w.blocks; ++i ) {
+        auto b = gen.next();
+        for( const auto& trace : b.traces ) handler.push_transaction_trace(trace);
+        handler.push_block_state(b.bs);
+        actions += b.actions;
+        last_block_num = b.bs->block_num;
+
+        pending.push_back(b.bs);
+        if( pending.size() > w.irreversible_lag ) {
+            handler.push_irreversible_block_state(pending.front());
+            pending.pop_front();
+        }
+    }
+    for( const auto& bs : pending ) handler.push_irreversible_block_state(bs);
+
+    const auto deadline = fc::time_point::now() + fc::seconds( vm["timeout"].as<uint32_t>() );
+    while( committed < last_block_num && !halted && fc::time_point::now() < deadline ) {
+        boost::this_thread::sleep_for( boost::chrono::milliseconds(10) );
+    }
+    const double elapsed = (fc::time_point::now() - started).count() / 1000000.0;
+    const int64_t reached = committed;
+    handler.shutdown();
+
+    if( reached < last_block_num ) {
+        elog( "${why} at block ${r} of ${l}, no result", ("why", halted ? "irreversible writer halted" : "timed out")("r", reached)("l", last_block_num) );
+        return 1;
+    }
+
+    std::cout << fc::json::to_pretty_string( fc::mutable_variant_object()
+        ("blocks", w.blocks)
+        ("actions", actions)
+        ("seconds", elapsed)
+        ("blocks_per_sec", w.blocks / elapsed)
+        ("actions_per_sec", actions / elapsed)
+        ("stages", metrics::instance().report()) ) << std::endl;
+    return 0;
+}
+
+} // namespace bench
+
+int main( int argc, char** argv ) {
+    try {
+        return bench::run(argc, argv);
+    } catch( const fc::exception& e ) {
+        elog( "${e}", ("e", e.to_detail_string()) );
+    } catch( const std::exception& e ) {
+        elog( "${e}", ("e", e.what()) );
+    }
+    return 1;
+}
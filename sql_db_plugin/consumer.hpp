@@ -5,108 +5,202 @@
 
 #pragma once
 
+#include <functional>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
 #include <boost/noncopyable.hpp>
-#include <boost/chrono.hpp>
 #include <boost/signals2/connection.hpp>
 #include <boost/thread/thread.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/condition_variable.hpp>
 #include <eosio/chain/block_state.hpp>
 #include <eosio/chain/transaction.hpp>
 #include <fc/log/logger.hpp>
 #include <eosio/sql_db_plugin/database.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+#include "pipeline.hpp"
 
 // #include "database.hpp"
 
 namespace eosio {
 
+// a block's transactions are unpacked in tasks of this many, spam blocks split into hundreds
+const size_t transactions_per_decode_task = 16;
+// an irreversible block that keeps failing is tried this many times, a second apart, then given up on
+const uint32_t max_irreversible_attempts = 30;
+
+template<typename T>
+struct queued {
+    T entry;
+    fc::time_point enqueued;
+};
+
+// the reversible stream keeps signal order across its two kinds of entries, exactly one is set
+struct reversible_entry {
+    chain::transaction_trace_ptr trace;
+    chain::block_state_ptr block;
+    // decode stage output for `trace`
+    std::string encoded_trace;
+};
+
+/**
+ * Block numbers one stream has reached, published as gauges together with their
+ * distance from the chain position the stream follows (head or last irreversible).
+ */
+class stream_progress {
+    public:
+        stream_progress( const std::string& stream, const std::string& reference ):
+            chain_block_num( metrics::instance().gauge("chain." + reference) ),
+            last_enqueued( metrics::instance().gauge(stream + ".last_enqueued") ),
+            last_decoded( metrics::instance().gauge(stream + ".last_decoded") ),
+            last_committed( metrics::instance().gauge(stream + ".last_committed") ),
+            enqueued_lag( metrics::instance().gauge(stream + ".enqueued_lag") ),
+            decoded_lag( metrics::instance().gauge(stream + ".decoded_lag") ),
+            committed_lag( metrics::instance().gauge(stream + ".committed_lag") )
+            { }
+
+        void chain( uint32_t block_num ) { chain_block_num = block_num; update(); }
+        void enqueued( uint32_t block_num ) { last_enqueued = block_num; update(); }
+        void decoded( uint32_t block_num ) { last_decoded = block_num; update(); }
+        void committed( uint32_t block_num ) { last_committed = block_num; update(); }
+
+        std::atomic<int64_t>& chain_block_num;
+        std::atomic<int64_t>& last_enqueued;
+        std::atomic<int64_t>& last_decoded;
+        std::atomic<int64_t>& last_committed;
+
+    private:
+        void update() {
+            int64_t reference = chain_block_num;
+            enqueued_lag = reference - last_enqueued;
+            decoded_lag = reference - last_decoded;
+            committed_lag = reference - last_committed;
+        }
+
+        std::atomic<int64_t>& enqueued_lag;
+        std::atomic<int64_t>& decoded_lag;
+        std::atomic<int64_t>& committed_lag;
+};
+
+/**
+ * Writes the two streams nodeos signals into SQL, each an ordered_stream: the reversible
+ * stream (traces and blocks in signal order) and the irreversible stream.
+ * Decoding (trace serialization, transaction unpacking) is split into tasks for a work
+ * stealing pool of `threads` workers, so one large block spreads over every idle worker.
+ * Each stream's writer runs on its own strand, with its own database, on an io_context
+ * with a thread per stream: the irreversible writer blocks its thread while it polls for
+ * rows of the reversible one.
+ */
 class consumer final : public boost::noncopyable {
     public:
-        consumer(std::unique_ptr<database> db,std::unique_ptr<database> db2, size_t queue_size);
+        consumer(std::unique_ptr<database> db,std::unique_ptr<database> db2, size_t queue_size, uint32_t checkpoint_block_num = 0,
+                 fc::microseconds stats_interval = fc::seconds(60), uint32_t threads = 2);
         ~consumer();
         void shutdown();
 
-        template<typename Queue, typename Entry>
-        void queue(boost::mutex&, boost::condition_variable&, Queue&, const Entry&, size_t );
-
-        void push_transaction_metadata( const chain::transaction_metadata_ptr& );
         void push_transaction_trace( const chain::transaction_trace_ptr& );
         void push_block_state( const chain::block_state_ptr& );
         void push_irreversible_block_state( const chain::block_state_ptr& );
-        void run_reversible();
-        void run_irreversible();
-
-        std::deque<chain::block_state_ptr> block_state_queue;
-        std::deque<chain::block_state_ptr> block_state_process_queue;
-        std::deque<chain::block_state_ptr> irreversible_block_state_queue;
-        std::deque<chain::block_state_ptr> irreversible_block_state_process_queue;
-        std::deque<chain::transaction_metadata_ptr> transaction_metadata_queue;
-        std::deque<chain::transaction_metadata_ptr> transaction_metadata_process_queue;
-        std::deque<chain::transaction_trace_ptr> transaction_trace_queue;
-        std::deque<chain::transaction_trace_ptr> transaction_trace_process_queue;
+
+        template<typename Stream, typename Entry>
+        void queue( Stream& stream, Entry&& e );
+
+        size_t split_reversible( queued<reversible_entry>& );
+        void decode_reversible( queued<reversible_entry>&, size_t task );
+        void write_reversible( std::vector<queued<reversible_entry>>& );
+        size_t split_irreversible( queued<decoded_block>& );
+        void decode_irreversible( queued<decoded_block>&, size_t task );
+        void write_irreversible( std::vector<queued<decoded_block>>& );
+        // false when the block was given up on shutdown
+        bool write_irreversible_block( const decoded_block& );
 
         std::unique_ptr<database> db;
         std::unique_ptr<database> db2;
         size_t queue_size;
+        // blocks at or below the sync_state checkpoint were already committed, they are skipped without touching SQL
+        uint32_t checkpoint_block_num;
+        fc::microseconds stats_interval;
+        stream_progress reversible_progress{"reversible", "head_block_num"};
+        stream_progress irreversible_progress{"irreversible", "last_irreversible_block_num"};
+        std::atomic<int64_t>& irreversible_head_distance = metrics::instance().gauge("irreversible.head_distance");
+        // signalled by the reversible writer, waited on by the irreversible one
+        write_progress progress;
+        // once a block is given up, later ones must not checkpoint past it
+        bool irreversible_halted = false;
+        // called from the irreversible writer when it gives up on a failing block
+        std::function<void()> on_irreversible_failure;
         boost::atomic<bool> exit{false};
-        boost::thread consume_thread_run_reversible;
-        boost::thread consume_thread_run_irreversible;
-        boost::mutex mtx;
-        boost::mutex mtx_irreversible;
-        boost::mutex mtx_db;
-        boost::condition_variable condition;
 
+        work_stealing_pool decode_pool;
+        boost::asio::io_context io;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+        ordered_stream<queued<reversible_entry>> reversible;
+        ordered_stream<queued<decoded_block>> irreversible;
+        boost::thread_group writer_threads;
     };
 
-    consumer::consumer(std::unique_ptr<database> db, std::unique_ptr<database> db2, size_t queue_size):
+    consumer::consumer(std::unique_ptr<database> db, std::unique_ptr<database> db2, size_t queue_size, uint32_t checkpoint_block_num,
+                       fc::microseconds stats_interval, uint32_t thread_count):
         db(std::move(db)),
         db2(std::move(db2)),
         queue_size(queue_size),
-        exit(false),
-        consume_thread_run_reversible(boost::thread([&]{this->run_reversible();})),
-        consume_thread_run_irreversible(boost::thread([&]{this->run_irreversible();}))
-        { }
+        checkpoint_block_num(checkpoint_block_num),
+        stats_interval(stats_interval),
+        decode_pool(thread_count),
+        work(boost::asio::make_work_guard(io)),
+        reversible(io, decode_pool, queue_size,
+                   [this]( queued<reversible_entry>& e ){ return split_reversible(e); },
+                   [this]( queued<reversible_entry>& e, size_t task ){ decode_reversible(e, task); },
+                   [this]( std::vector<queued<reversible_entry>>& b ){ write_reversible(b); }),
+        irreversible(io, decode_pool, queue_size,
+                     [this]( queued<decoded_block>& e ){ return split_irreversible(e); },
+                     [this]( queued<decoded_block>& e, size_t task ){ decode_irreversible(e, task); },
+                     [this]( std::vector<queued<decoded_block>>& b ){ write_irreversible(b); })
+        {
+            ilog("Consumer started with ${n} decode threads", ("n", decode_pool.size()));
+            // blocks up to the checkpoint are committed, the ones after it not until they are written
+            irreversible_progress.decoded(checkpoint_block_num);
+            irreversible_progress.committed(checkpoint_block_num);
+            // one per stream's strand
+            for( int i = 0; i < 2; ++i ) writer_threads.create_thread([this]{ io.run(); });
+        }
 
     consumer::~consumer() {
-        exit = true;
-        condition.notify_all();
-        consume_thread_run_reversible.join();
-        consume_thread_run_irreversible.join();
+        shutdown();
     }
 
     void consumer::shutdown() {
-        exit = true;
-        condition.notify_all();
-        consume_thread_run_reversible.join();
-        consume_thread_run_irreversible.join();
+        if( exit.exchange(true) ) return;
+        reversible.close();
+        irreversible.close();
+        ilog("reversible draining queue, size: ${q}", ("q", reversible.in_flight()));
+        // rows the irreversible writer may be waiting for land first
+        reversible.wait_drained();
+        progress.stop();
+        ilog("irreversible draining queue, size: ${q}", ("q", irreversible.in_flight()));
+        // entries still decoding are posted to the strands later, the writers stay up for them
+        irreversible.wait_drained();
+        work.reset();
+        writer_threads.join_all();
+        decode_pool.stop();
+        ilog("Consumer stopped");
     }
 
-    template<typename Queue, typename Entry>
-    void consumer::queue(boost::mutex& mtx, boost::condition_variable& condition, Queue& queue, const Entry& e, size_t queue_size) {
-        int sleep_time = 100;
-        size_t last_queue_size = 0;
-        boost::mutex::scoped_lock lock(mtx);
-        if (queue.size() > queue_size) {
-            lock.unlock();
-            condition.notify_one();
-            if (last_queue_size < queue.size()) {
-                sleep_time += 100;
-            } else {
-                sleep_time -= 100;
-                if (sleep_time < 0) sleep_time = 100;
-            }
-            last_queue_size = queue.size();
-            boost::this_thread::sleep_for(boost::chrono::milliseconds(sleep_time));
-            lock.lock();
-        }
-        queue.emplace_back(e);
-        lock.unlock();
-        condition.notify_all();
+    template<typename Stream, typename Entry>
+    void consumer::queue( Stream& stream, Entry&& e ) {
+        static auto& wait_latency = metrics::instance().histogram("enqueue_wait");
+        scoped_latency timer(wait_latency);
+        stream.push( { std::forward<Entry>(e), fc::time_point::now() } );
     }
 
     void consumer::push_block_state( const chain::block_state_ptr& bs ){
+        reversible_progress.chain(bs->block_num);
+        irreversible_head_distance = int64_t(bs->block_num) - irreversible_progress.last_committed;
+        if( bs->block_num <= checkpoint_block_num ) return;
         try {
-            queue(mtx, condition, block_state_queue, bs, queue_size);
+            reversible_entry e;
+            e.block = bs;
+            queue(reversible, std::move(e));
+            reversible_progress.enqueued(bs->block_num);
         } catch (fc::exception& e) {
             elog("FC Exception while accepted_block ${e}", ("e", e.to_string()));
         } catch (std::exception& e) {
@@ -117,8 +211,13 @@ class consumer final : public boost::noncopyable {
     }
 
     void consumer::push_irreversible_block_state( const chain::block_state_ptr& bs ){
+        irreversible_progress.chain(bs->block_num);
+        if( bs->block_num <= checkpoint_block_num ) return;
         try {
-            queue(mtx_irreversible, condition, irreversible_block_state_queue, bs, queue_size);
+            decoded_block e;
+            e.block = bs;
+            queue(irreversible, std::move(e));
+            irreversible_progress.enqueued(bs->block_num);
         } catch (fc::exception& e) {
             elog("FC Exception while applied_irreversible_block ${e}", ("e", e.to_string()));
         } catch (std::exception& e) {
@@ -128,21 +227,12 @@ class consumer final : public boost::noncopyable {
         }
     }
 
-    void consumer::push_transaction_metadata( const chain::transaction_metadata_ptr& tm){
-        try {
-            queue(mtx, condition, transaction_metadata_queue, tm, queue_size);
-        } catch (fc::exception& e) {
-            elog("FC Exception while accepted_transaction ${e}", ("e", e.to_string()));
-        } catch (std::exception& e) {
-            elog("STD Exception while accepted_transaction ${e}", ("e", e.what()));
-        } catch (...) {
-            elog("Unknown exception while accepted_transaction");
-        }
-    }
-
     void consumer::push_transaction_trace( const chain::transaction_trace_ptr& tt){
+        if( tt->block_num <= checkpoint_block_num ) return;
         try {
-            queue(mtx, condition, transaction_trace_queue, tt, queue_size);
+            reversible_entry e;
+            e.trace = tt;
+            queue(reversible, std::move(e));
         } catch (fc::exception& e) {
             elog("FC Exception while applied_transaction ${e}", ("e", e.to_string()));
         } catch (std::exception& e) {
@@ -151,124 +241,111 @@ class consumer final : public boost::noncopyable {
             elog("Unknown exception while applied_transaction");
         }
     }
-    
-
-    void consumer::run_reversible() {
-        ilog("Consumer thread Start run_reversible");
-        while (!exit) { 
-            try{
-                boost::mutex::scoped_lock lock(mtx);
-                while(block_state_queue.empty()&&
-                        transaction_metadata_queue.empty()&&
-                            transaction_trace_queue.empty()&& !exit){
-                    condition.wait(lock);
-                }
-
-                size_t block_state_size = block_state_queue.size();
-                if( block_state_size > 0 ){
-                    block_state_process_queue = std::move(block_state_queue);
-                }
-
-                size_t transaction_metadata_size = transaction_metadata_queue.size();
-                if( transaction_metadata_size > 0 ){
-                    transaction_metadata_process_queue = std::move(transaction_metadata_queue);
-                }
-
-                size_t transaction_trace_size = transaction_trace_queue.size();
-                if( transaction_trace_size > 0 ){
-                    transaction_trace_process_queue = std::move(transaction_trace_queue);
-                }
 
-                lock.unlock();
+    size_t consumer::split_reversible( queued<reversible_entry>& e ) {
+        return e.entry.trace ? 1 : 0;
+    }
 
-                if( block_state_size > (queue_size * 0.75) ||
-                    transaction_metadata_size > (queue_size * 0.75) ||
-                    transaction_trace_size> (queue_size * 0.75)) {
-                    wlog("reversible queue size: ${q}", ("q", transaction_metadata_size + transaction_trace_size + block_state_size));
-                } else if (exit) {
-                    ilog("reversible draining queue, size: ${q}", ("q", transaction_metadata_size + transaction_trace_size + block_state_size));
-                }
+    void consumer::decode_reversible( queued<reversible_entry>& e, size_t ) {
+        e.entry.encoded_trace = db->encode_transaction_trace( *e.entry.trace );
+    }
 
+    void consumer::write_reversible( std::vector<queued<reversible_entry>>& batch ) {
+        static auto& residency = metrics::instance().histogram("queue_residency.reversible");
 
-                //process trace
-                while (!transaction_trace_process_queue.empty()) {
-                    const auto& tt = transaction_trace_process_queue.front();
-                    db->consume_transaction_trace(tt);
-                    transaction_trace_process_queue.pop_front();
-                }
+        const auto in_flight = reversible.in_flight();
+        if( in_flight > queue_size * 0.75 ) {
+            wlog("reversible queue size: ${q}", ("q", in_flight));
+        }
 
-                // process transactions
-                while (!transaction_metadata_process_queue.empty()) {
-                    const auto& tm = transaction_metadata_process_queue.front();
-                    db->consume_transaction_metadata(tm);
-                    transaction_metadata_process_queue.pop_front();
-                }             
-
-                // process blocks
-                while (!block_state_process_queue.empty()) {
-                    const auto& bs = block_state_process_queue.front();
-                    db->consume_block_state( bs );
-                    block_state_process_queue.pop_front();
+        for( auto& e : batch ) {
+            residency.record( (fc::time_point::now() - e.enqueued).count() );
+            try {
+                if( e.entry.trace ) {
+                    db->consume_transaction_trace( e.entry.trace, e.entry.encoded_trace );
+                } else if( e.entry.block ) {
+                    const auto block_num = e.entry.block->block_num;
+                    db->consume_block_state( e.entry.block );
+                    // a block entry has nothing to decode, both steps are done once its rows are written
+                    reversible_progress.decoded(block_num);
+                    reversible_progress.committed(block_num);
                 }
-
-                condition.notify_all();
-            } catch (fc::exception& e) {
-                elog("FC Exception while consuming block ${e}", ("e", e.to_string()));
-            } catch (std::exception& e) {
-                elog("STD Exception while consuming block ${e}", ("e", e.what()));
+            } catch (fc::exception& ex) {
+                elog("FC Exception while consuming block ${e}", ("e", ex.to_string()));
+            } catch (std::exception& ex) {
+                elog("STD Exception while consuming block ${e}", ("e", ex.what()));
             } catch (...) {
                 elog("Unknown exception while consuming block");
-            }  
-
+            }
         }
-        
-        ilog("Consumer thread End run_reversible");
+
+        progress.notify();
+        metrics::instance().maybe_log(stats_interval);
+        statement_stats::instance().maybe_log(stats_interval);
     }
 
-    void consumer::run_irreversible() {
-        ilog("Consumer thread Start run_irreversible");
-        while (!exit) { 
-            try{
-                boost::mutex::scoped_lock lock(mtx_irreversible);
-                while(irreversible_block_state_queue.empty() && !exit){
-                    condition.wait(lock);
-                }
+    size_t consumer::split_irreversible( queued<decoded_block>& e ) {
+        return ( e.entry.prepare() + transactions_per_decode_task - 1 ) / transactions_per_decode_task;
+    }
 
+    void consumer::decode_irreversible( queued<decoded_block>& e, size_t task ) {
+        e.entry.decode( task * transactions_per_decode_task, (task + 1) * transactions_per_decode_task );
+    }
 
-                size_t irreversible_block_state_size = irreversible_block_state_queue.size();
-                if( irreversible_block_state_size > 0 ){
-                    irreversible_block_state_process_queue = std::move(irreversible_block_state_queue);
-                }
+    void consumer::write_irreversible( std::vector<queued<decoded_block>>& batch ) {
+        static auto& residency = metrics::instance().histogram("queue_residency.irreversible");
 
-                lock.unlock();
+        const auto in_flight = irreversible.in_flight();
+        if( in_flight > queue_size * 0.75 ) {
+            wlog("irreversible queue size: ${q}", ("q", in_flight));
+        }
 
-                if( irreversible_block_state_size > (queue_size * 0.75) ) {
-                    wlog("irreversible queue size: ${q}", ("q", irreversible_block_state_size));
-                } else if (exit) {
-                    ilog("irreversible draining queue, size: ${q}", ("q", irreversible_block_state_size));
-                }
+        for( auto& e : batch ) {
+            if( irreversible_halted ) return;
+            residency.record( (fc::time_point::now() - e.enqueued).count() );
+            const auto block_num = e.entry.block->block_num;
+            // a receipt the decode stage failed on is decoded in place by the write
+            const bool decoded = e.entry.complete();
+            if( decoded ) irreversible_progress.decoded(block_num);
+            if( !write_irreversible_block( e.entry ) ) {
+                irreversible_halted = true;
+                return;
+            }
+            if( !decoded ) irreversible_progress.decoded(block_num);
+            irreversible_progress.committed(block_num);
+            irreversible_head_distance = reversible_progress.chain_block_num - int64_t(block_num);
+        }
 
-                boost::mutex::scoped_lock lock_db(mtx_db);
-                
-                // process irreversible blocks
-                while (!irreversible_block_state_process_queue.empty()) {
-                    const auto& bs = irreversible_block_state_process_queue.front();
-                    db2->consume_irreversible_block_state(bs, lock_db, condition, exit);
-                    irreversible_block_state_process_queue.pop_front();
-                }
-                lock_db.unlock();
+        metrics::instance().maybe_log(stats_interval);
+        statement_stats::instance().maybe_log(stats_interval);
+    }
+
+    bool consumer::write_irreversible_block( const decoded_block& block ) {
+        static auto& block_latency = metrics::instance().histogram("irreversible_block");
+        static auto& failed_attempts = metrics::instance().counter("irreversible_block.failures");
+        // a failed block is retried, it must not be skipped by the checkpoint
+        for( uint32_t attempt = 1; ; ++attempt ) {
+            try {
+                scoped_latency timer(block_latency);
+                return db2->consume_irreversible_block_state( block, progress );
             } catch (fc::exception& e) {
                 elog("FC Exception while consuming block ${e}", ("e", e.to_string()));
             } catch (std::exception& e) {
                 elog("STD Exception while consuming block ${e}", ("e", e.what()));
             } catch (...) {
                 elog("Unknown exception while consuming block");
-            }  
-
+            }
+            ++failed_attempts;
+            // the attempt's transaction rolled back, what it put in the in-memory caches goes too
+            db2->discard_pending();
+            if( attempt == max_irreversible_attempts ) {
+                elog( "irreversible block ${n} failed ${a} times, nothing from it on is written",
+                      ("n", block.block->block_num)("a", attempt) );
+                if( on_irreversible_failure ) on_irreversible_failure();
+                return false;
+            }
+            if( !progress.wait( fc::seconds(1) ) ) return false;
         }
-        
-        ilog("Consumer thread End run_irreversible");
     }
 
 } // namespace
-
@@ -0,0 +1,150 @@
+#include <eosio/sql_db_plugin/abi_history_table.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    namespace {
+        // beyond this many ABI versions the cache starts over, accounts are read back as they are used
+        const size_t max_cached_versions = 4096;
+    }
+
+    abi_version::abi_version( uint32_t block_num, chain::abi_def abi, const fc::microseconds& max_serialization_time ):
+        block_num(block_num), abi(std::move(abi)), max_serialization_time(max_serialization_time),
+        writer(this->abi, max_serialization_time), serializer(this->abi, max_serialization_time) {
+    }
+
+    abi_history_table::abi_history_table( std::shared_ptr<sql_session> session ):
+        m_session(session) {
+
+    }
+
+    void abi_history_table::drop() {
+        try {
+            m_session->execute( "DROP TABLE IF EXISTS abi_history" );
+        }
+        catch(std::exception& e){
+            wlog(e.what());
+        }
+    }
+
+    void abi_history_table::create() {
+        m_session->execute( "CREATE TABLE `abi_history` ("
+                "`account` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`block_num` bigint(20) NOT NULL DEFAULT '0',"
+                "`abi_bin` mediumblob NOT NULL,"
+                "`created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,"
+                "PRIMARY KEY (`account`,`block_num`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+    }
+
+    void abi_history_table::add( const chain::account_name& account, uint32_t block_num, const chain::bytes& abi_bin ) {
+        // a second setabi in the same block wins, as it does on chain
+        const std::string bin( abi_bin.begin(), abi_bin.end() );
+        m_session->execute( "INSERT INTO abi_history(account, block_num, abi_bin) VALUES (:ac, :bn, :abi) "
+                    "ON DUPLICATE KEY UPDATE abi_bin = VALUES(abi_bin)",
+            soci::use(account.to_string()),
+            soci::use(block_num),
+            soci::use(bin) );
+    }
+
+    std::map<uint32_t, chain::abi_def> abi_history_table::load( const chain::account_name& account ) {
+        std::map<uint32_t, chain::abi_def> versions;
+        const auto name = account.to_string();
+        {
+            soci::rowset<soci::row> rs = m_session->rowset<soci::row>(
+                "SELECT block_num, abi_bin FROM abi_history WHERE account = :ac ORDER BY block_num",
+                soci::use(name) );
+            for( const auto& r : rs ) {
+                const auto bin = r.get<std::string>(1);
+                try {
+                    versions.emplace( uint32_t( r.get<long long>(0) ), fc::raw::unpack<chain::abi_def>( chain::bytes(bin.begin(), bin.end()) ) );
+                } catch( fc::exception& e ) {
+                    wlog( "unreadable ABI of ${a} at block ${n}: ${e}", ("a", name)("n", r.get<long long>(0))("e", e.to_string()) );
+                }
+            }
+        }
+        if( !versions.empty() ) return versions;
+
+        std::string abi_json;
+        long long abi_block_num = 0;
+        soci::indicator ind;
+        m_session->execute( "SELECT abi, abi_block_num FROM accounts WHERE name = :name",
+            soci::into(abi_json, ind), soci::into(abi_block_num), soci::use(name) );
+        if( ind == soci::i_ok && !abi_json.empty() ) {
+            try {
+                versions.emplace( uint32_t(abi_block_num), fc::json::from_string(abi_json).as<chain::abi_def>() );
+            } catch( fc::exception& e ) {
+                wlog( "unreadable ABI of ${a}: ${e}", ("a", name)("e", e.to_string()) );
+            }
+        }
+        return versions;
+    }
+
+    abi_cache& abi_cache::instance() {
+        static abi_cache c;
+        return c;
+    }
+
+    abi_version_ptr abi_cache::lookup( const account_versions& account, uint32_t block_num ) const {
+        if( account.versions.empty() ) return abi_version_ptr();
+        if( block_num == 0 ) return account.versions.rbegin()->second;
+        auto itr = account.versions.upper_bound(block_num);
+        if( itr == account.versions.begin() ) return abi_version_ptr();
+        return (--itr)->second;
+    }
+
+    abi_version_ptr abi_cache::find( abi_history_table& history, const chain::account_name& account, uint32_t block_num ) {
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            auto itr = m_accounts.find(account);
+            if( itr != m_accounts.end() && itr->second.loaded ) return lookup( itr->second, block_num );
+        }
+
+        // parse outside the lock; a concurrent loader of the same account only wastes work
+        std::map<uint32_t, abi_version_ptr> loaded;
+        for( auto& v : history.load(account) ) {
+            loaded.emplace( v.first, std::make_shared<const abi_version>( v.first, std::move(v.second), m_max_serialization_time ) );
+        }
+
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& entry = m_accounts[account];
+        // versions added meanwhile may not be visible to this connection yet, they take precedence
+        const auto before = entry.versions.size();
+        entry.versions.insert( loaded.begin(), loaded.end() );
+        m_versions += entry.versions.size() - before;
+        entry.loaded = true;
+        return lookup( entry, block_num );
+    }
+
+    void abi_cache::add( const chain::account_name& account, uint32_t block_num, const chain::abi_def& abi ) {
+        auto version = std::make_shared<const abi_version>( block_num, abi, m_max_serialization_time );
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& slot = m_accounts[account].versions[block_num];
+        if( !slot ) ++m_versions;
+        slot = std::move(version);
+        m_uncommitted.emplace_back( account, block_num );
+    }
+
+    void abi_cache::committed() {
+        boost::mutex::scoped_lock lock(m_mtx);
+        m_uncommitted.clear();
+        // nothing is uncommitted here, so the versions just written are in abi_history for the reload
+        if( m_versions > max_cached_versions ) {
+            m_accounts.clear();
+            m_versions = 0;
+        }
+    }
+
+    void abi_cache::discard() {
+        boost::mutex::scoped_lock lock(m_mtx);
+        for( const auto& v : m_uncommitted ) {
+            auto itr = m_accounts.find(v.first);
+            if( itr != m_accounts.end() ) m_versions -= itr->second.versions.erase(v.second);
+        }
+        m_uncommitted.clear();
+    }
+
+} // namespace
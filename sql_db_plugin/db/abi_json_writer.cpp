@@ -0,0 +1,210 @@
+#include <eosio/sql_db_plugin/abi_json_writer.hpp>
+
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/block_timestamp.hpp>
+#include <eosio/chain/types.hpp>
+
+#include <fc/io/raw.hpp>
+
+#include <cstring>
+#include <set>
+
+namespace eosio {
+
+    namespace {
+        // same limit abi_serializer applies
+        const uint32_t max_recursion_depth = 32;
+
+        bool is_name( const std::string& type ) {
+            return type == "name" || type == "account_name" || type == "permission_name" ||
+                   type == "action_name" || type == "scope_name" || type == "table_name";
+        }
+
+        bool ends_with( const std::string& s, const char* suffix, size_t n ) {
+            return s.size() >= n && s.compare( s.size() - n, n, suffix ) == 0;
+        }
+    }
+
+    void abi_json_writer::reader::read( void* dest, size_t size ) {
+        FC_ASSERT( size_t(end - pos) >= size, "read past the end of the action data" );
+        memcpy( dest, pos, size );
+        pos += size;
+    }
+
+    uint32_t abi_json_writer::reader::read_varuint32() {
+        uint64_t v = 0;
+        uint8_t b = 0;
+        uint8_t by = 0;
+        do {
+            read( &b, 1 );
+            v |= uint64_t(b & 0x7f) << by;
+            by += 7;
+        } while( (b & 0x80) && by < 32 );
+        return uint32_t(v);
+    }
+
+    template<typename T>
+    static T unpack( abi_json_writer::reader& in ) {
+        fc::datastream<const char*> ds( in.pos, in.end - in.pos );
+        T v;
+        fc::raw::unpack( ds, v );
+        in.pos += ds.tellp();
+        return v;
+    }
+
+    abi_json_writer::abi_json_writer( const chain::abi_def& abi, fc::microseconds max_serialization_time ):
+        m_abi(abi), m_max_serialization_time(max_serialization_time) {
+        for( const auto& t : abi.types ) m_typedefs.emplace( t.new_type_name, t.type );
+        for( const auto& s : abi.structs ) m_structs.emplace( s.name, &s );
+    }
+
+    std::string abi_json_writer::action_type( const chain::action_name& action ) const {
+        for( const auto& a : m_abi.actions ) {
+            if( a.name == action ) return a.type;
+        }
+        return std::string();
+    }
+
+    const std::string& abi_json_writer::resolve( const std::string& type ) const {
+        const std::string* t = &type;
+        for( uint32_t i = 0; i < max_recursion_depth; ++i ) {
+            auto itr = m_typedefs.find(*t);
+            if( itr == m_typedefs.end() ) return *t;
+            t = &itr->second;
+        }
+        FC_THROW( "typedef chain too deep for ${t}", ("t", type) );
+    }
+
+    bool abi_json_writer::write( const std::string& type, const std::vector<char>& data, std::string& out, const name_field_callback& on_name ) const {
+        const auto mark = out.size();
+        context ctx{ { data.data(), data.data() + data.size() }, fc::time_point::now() + m_max_serialization_time, on_name ? &on_name : nullptr };
+        json_writer writer(out);
+        try {
+            const auto& rtype = resolve(type);
+            auto s = m_structs.find(rtype);
+            if( s != m_structs.end() ) {
+                bool first = true;
+                out += '{';
+                write_struct( *s->second, ctx, writer, 1, first, true );
+                out += '}';
+            } else {
+                write_type( rtype, ctx, writer, 1 );
+            }
+        } catch( const unsupported& ) {
+            out.resize(mark);
+            return false;
+        }
+        return true;
+    }
+
+    void abi_json_writer::write_struct( const chain::struct_def& def, context& ctx, json_writer& out, uint32_t depth, bool& first, bool top_level ) const {
+        FC_ASSERT( depth < max_recursion_depth, "recursive definition in ${t}", ("t", def.name) );
+        FC_ASSERT( fc::time_point::now() < ctx.deadline, "serialization time limit exceeded" );
+
+        if( !def.base.empty() ) {
+            auto base = m_structs.find( resolve(def.base) );
+            if( base == m_structs.end() ) throw unsupported();
+            write_struct( *base->second, ctx, out, depth + 1, first, top_level );
+        }
+
+        for( const auto& field : def.fields ) {
+            if( !first ) out.write_raw(',');
+            first = false;
+            out.write_plain( field.name );
+            out.write_raw(':');
+
+            const auto& ftype = resolve( field.type );
+            // only the action's own fields, as fc::json::from_string(data).as<system_contract_arg>() saw them
+            if( ctx.on_name && top_level && is_name(ftype) ) {
+                auto n = unpack<chain::name>(ctx.in);
+                out.write(n);
+                (*ctx.on_name)( field.name, n );
+            } else {
+                write_type( ftype, ctx, out, depth + 1 );
+            }
+        }
+    }
+
+    void abi_json_writer::write_type( const std::string& type, context& ctx, json_writer& out, uint32_t depth ) const {
+        FC_ASSERT( depth < max_recursion_depth, "recursive definition in ${t}", ("t", type) );
+        const auto& rtype = resolve(type);
+        auto& in = ctx.in;
+
+        if( ends_with(rtype, "[]", 2) ) {
+            const auto element = rtype.substr( 0, rtype.size() - 2 );
+            auto size = in.read_varuint32();
+            out.write_raw('[');
+            for( uint32_t i = 0; i < size; ++i ) {
+                if( i ) out.write_raw(',');
+                write_type( element, ctx, out, depth + 1 );
+            }
+            out.write_raw(']');
+            return;
+        }
+        if( ends_with(rtype, "?", 1) ) {
+            uint8_t flag = 0;
+            in.read( &flag, 1 );
+            if( flag ) write_type( rtype.substr(0, rtype.size() - 1), ctx, out, depth + 1 );
+            else out.write_null();
+            return;
+        }
+        if( ends_with(rtype, "$", 1) ) throw unsupported();
+
+        if( write_builtin(rtype, in, out) ) return;
+
+        auto s = m_structs.find(rtype);
+        if( s == m_structs.end() ) throw unsupported();
+        bool first = true;
+        out.write_raw('{');
+        write_struct( *s->second, ctx, out, depth + 1, first, false );
+        out.write_raw('}');
+    }
+
+    bool abi_json_writer::write_builtin( const std::string& type, reader& in, json_writer& out ) const {
+        if( is_name(type) ) { out.write( unpack<chain::name>(in) ); return true; }
+        if( type == "string" ) { out.write( unpack<std::string>(in) ); return true; }
+        if( type == "bool" ) { out.write( unpack<bool>(in) ); return true; }
+        if( type == "uint8" ) { out.write_uint( unpack<uint8_t>(in) ); return true; }
+        if( type == "uint16" ) { out.write_uint( unpack<uint16_t>(in) ); return true; }
+        if( type == "uint32" ) { out.write_uint( unpack<uint32_t>(in) ); return true; }
+        if( type == "uint64" ) { out.write_uint( unpack<uint64_t>(in) ); return true; }
+        if( type == "int8" ) { out.write_int( unpack<int8_t>(in) ); return true; }
+        if( type == "int16" ) { out.write_int( unpack<int16_t>(in) ); return true; }
+        if( type == "int32" ) { out.write_int( unpack<int32_t>(in) ); return true; }
+        if( type == "int64" ) { out.write_int( unpack<int64_t>(in) ); return true; }
+        if( type == "varuint32" ) { out.write_uint( in.read_varuint32() ); return true; }
+        if( type == "varint32" ) { out.write_int( unpack<fc::signed_int>(in).value ); return true; }
+        if( type == "asset" ) { out.write_plain( unpack<chain::asset>(in).to_string() ); return true; }
+        if( type == "symbol" ) { out.write_plain( unpack<chain::symbol>(in).to_string() ); return true; }
+        if( type == "public_key" ) { out.write_plain( std::string( unpack<chain::public_key_type>(in) ) ); return true; }
+        if( type == "time_point_sec" ) { out.write_plain( std::string( unpack<fc::time_point_sec>(in) ) ); return true; }
+        if( type == "time_point" ) { out.write_plain( std::string( unpack<fc::time_point>(in) ) ); return true; }
+        if( type == "block_timestamp_type" ) {
+            out.write_plain( std::string( fc::time_point( unpack<chain::block_timestamp_type>(in) ) ) );
+            return true;
+        }
+        if( type == "bytes" ) {
+            auto size = in.read_varuint32();
+            FC_ASSERT( size_t(in.end - in.pos) >= size, "read past the end of the action data" );
+            out.write_hex( in.pos, size );
+            in.pos += size;
+            return true;
+        }
+
+        size_t checksum_size = type == "checksum256" ? 32 : type == "checksum160" ? 20 : type == "checksum512" ? 64 : 0;
+        if( checksum_size ) {
+            FC_ASSERT( size_t(in.end - in.pos) >= checksum_size, "read past the end of the action data" );
+            out.write_hex( in.pos, checksum_size );
+            in.pos += checksum_size;
+            return true;
+        }
+
+        // floats, 128-bit integers, signatures and the like stay with abi_serializer
+        static const std::set<std::string> builtins = {
+            "float32", "float64", "float128", "int128", "uint128", "signature", "symbol_code", "extended_asset"
+        };
+        if( builtins.count(type) ) throw unsupported();
+        return false;
+    }
+
+} // namespace
@@ -4,7 +4,7 @@
 
 namespace eosio {
 
-accounts_table::accounts_table(std::shared_ptr<soci::session> session):
+accounts_table::accounts_table(std::shared_ptr<sql_session> session):
     m_session(session)
 {
 
@@ -13,8 +13,8 @@ accounts_table::accounts_table(std::shared_ptr<soci::session> session):
 void accounts_table::drop()
 {
     try {
-        *m_session << "DROP TABLE IF EXISTS accounts_keys";
-        *m_session << "DROP TABLE IF EXISTS accounts";
+        m_session->execute( "DROP TABLE IF EXISTS accounts_keys" );
+        m_session->execute( "DROP TABLE IF EXISTS accounts" );
     }
     catch(std::exception& e){
         wlog(e.what());
@@ -23,47 +23,146 @@ void accounts_table::drop()
 
 void accounts_table::create()
 {
-    *m_session << "CREATE TABLE `accounts` ("
+    m_session->execute( "CREATE TABLE `accounts` ("
                     "`id` bigint(20) NOT NULL AUTO_INCREMENT,"
                     "`name` varchar(12) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                     "`abi` json DEFAULT NULL,"
+                    "`abi_block_num` bigint(20) NOT NULL DEFAULT '0',"
                     "`created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,"
                     "`updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,"
                     "PRIMARY KEY (`id`),"
                     "KEY `idx_accounts_name` (`name`)"
-                    ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+                    ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
 
-    *m_session << "CREATE TABLE `accounts_keys` ("
+    m_session->execute( "CREATE TABLE `accounts_keys` ("
                 "`id` bigint(20) NOT NULL AUTO_INCREMENT,"
                 "`account` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                 "`public_key` varchar(64) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                 "`permission` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                 "PRIMARY KEY (`id`),"
                 "KEY `account` (`account`)"
-                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
 }
 
 void accounts_table::add(string name) {
-    *m_session << "INSERT INTO accounts (name) VALUES (:name)",
-            soci::use(name);
+    account_dictionary::instance().intern(*m_session, chain::name(name));
+    account_dictionary::instance().committed(*m_session);
 }
 
 void accounts_table::add_eosio(string name,string abi) {
-    *m_session << "INSERT INTO accounts (name,abi) VALUES (:name,:abi)",
-            soci::use(name),soci::use(abi);
+    account_dictionary::instance().intern(*m_session, chain::name(name), abi);
+    account_dictionary::instance().committed(*m_session);
 }
 
 bool accounts_table::exist(string name)
 {
-    int amount;
-    try {
-        *m_session << "SELECT COUNT(*) FROM accounts WHERE name = :name", soci::into(amount), soci::use(name);
+    account_dictionary::instance().load(*m_session);
+    return account_dictionary::instance().exists(*m_session, chain::name(name));
+}
+
+account_dictionary& account_dictionary::instance() {
+    static account_dictionary d;
+    return d;
+}
+
+void account_dictionary::load( sql_session& session ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    if( m_loaded ) return;
+
+    // a failure propagates: an unloaded dictionary would report every account unknown and without ABI
+    std::unordered_map<uint64_t, entry> accounts;
+    soci::rowset<soci::row> rs = session.rowset<soci::row>(
+        "SELECT id, name, abi_block_num, abi IS NOT NULL FROM accounts ORDER BY id" );
+    for( const auto& r : rs ) {
+        entry e;
+        e.id = uint64_t( r.get<long long>(0) );
+        e.abi_block_num = uint32_t( r.get<long long>(2) );
+        if( r.get<long long>(3) ) e.flags |= has_abi;
+        // duplicates come later, the first row keeps the name
+        accounts.emplace( chain::name( r.get<std::string>(1) ).value, e );
+    }
+    m_accounts.swap(accounts);
+    m_loaded = true;
+    ilog( "account dictionary loaded, ${n} accounts", ("n", m_accounts.size()) );
+}
+
+const account_dictionary::entry* account_dictionary::lookup( const sql_session& session, uint64_t account ) const {
+    auto pending = m_pending.find(&session);
+    if( pending != m_pending.end() ) {
+        auto itr = pending->second.find(account);
+        if( itr != pending->second.end() ) return &itr->second;
     }
-    catch (std::exception const & e)
+    auto itr = m_accounts.find(account);
+    return itr != m_accounts.end() ? &itr->second : nullptr;
+}
+
+bool account_dictionary::exists( const sql_session& session, const chain::account_name& account ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    return lookup(session, account.value) != nullptr;
+}
+
+bool account_dictionary::has_abi( const sql_session& session, const chain::account_name& account ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    const auto* e = lookup(session, account.value);
+    return e && (e->flags & has_abi);
+}
+
+fc::optional<account_dictionary::entry> account_dictionary::find( const sql_session& session, const chain::account_name& account ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    const auto* e = lookup(session, account.value);
+    if( !e ) return fc::optional<entry>();
+    return *e;
+}
+
+uint64_t account_dictionary::intern( sql_session& session, const chain::account_name& account, const string& abi ) {
     {
-        amount = 0;
+        boost::mutex::scoped_lock lock(m_mtx);
+        if( const auto* known = lookup(session, account.value) ) return known->id;
     }
-    return amount > 0;
+
+    // inserted without the lock, new accounts are rare and only the irreversible writer adds them
+    const auto name = account.to_string();
+    if( abi.empty() ) {
+        session.execute( "INSERT INTO accounts (name) VALUES (:name)", soci::use(name) );
+    } else {
+        session.execute( "INSERT INTO accounts (name,abi) VALUES (:name,:abi)", soci::use(name), soci::use(abi) );
+    }
+    long long id = 0;
+    session.execute( "SELECT LAST_INSERT_ID()", soci::into(id) );
+
+    entry e;
+    e.id = uint64_t(id);
+    if( !abi.empty() ) e.flags |= has_abi;
+
+    boost::mutex::scoped_lock lock(m_mtx);
+    // committed by another session meanwhile: the row just inserted is a later duplicate, the first one keeps the name
+    if( const auto* known = lookup(session, account.value) ) return known->id;
+    m_pending[&session].emplace( account.value, e );
+    return e.id;
+}
+
+void account_dictionary::set_abi( const sql_session& session, const chain::account_name& account, uint32_t block_num ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    const auto* known = lookup(session, account.value);
+    if( !known ) return;
+    // staged on a copy, the committed entry stays as it is until the transaction commits
+    entry e = *known;
+    e.abi_block_num = block_num;
+    e.flags |= has_abi;
+    m_pending[&session][account.value] = e;
+}
+
+void account_dictionary::committed( const sql_session& session ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    auto pending = m_pending.find(&session);
+    if( pending == m_pending.end() ) return;
+    for( const auto& p : pending->second ) m_accounts[p.first] = p.second;
+    m_pending.erase(pending);
+}
+
+void account_dictionary::discard( const sql_session& session ) {
+    boost::mutex::scoped_lock lock(m_mtx);
+    m_pending.erase(&session);
 }
 
 } // namespace
@@ -0,0 +1,119 @@
+#include <eosio/sql_db_plugin/action_decoder.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+namespace eosio {
+
+    namespace {
+        // pause between full batches, so the decoder never competes with the writers for long
+        const fc::microseconds busy_pause = fc::milliseconds(10);
+    }
+
+    action_decoder::action_decoder( const std::string& uri, const std::string& abi_uri, uint32_t batch_size, fc::microseconds idle ):
+        m_session( std::make_shared<sql_session>(uri) ),
+        m_abi_history( abi_uri == uri ? m_session : std::make_shared<sql_session>(abi_uri) ),
+        m_batch_size(batch_size), m_idle(idle) {
+    }
+
+    action_decoder::~action_decoder() {
+        stop();
+    }
+
+    void action_decoder::start() {
+        m_thread = boost::thread([this]{ run(); });
+    }
+
+    void action_decoder::stop() {
+        m_exit = true;
+        m_cond.notify_one();
+        if( m_thread.joinable() ) m_thread.join();
+    }
+
+    void action_decoder::idle( fc::microseconds duration ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        if( !m_exit ) m_cond.timed_wait( lock, boost::posix_time::microseconds( duration.count() ) );
+    }
+
+    void action_decoder::run() {
+        ilog("lazy action decoder started, ${n} rows per batch", ("n", m_batch_size));
+        while( !m_exit ) {
+            size_t examined = 0;
+            try {
+                examined = decode_batch();
+            } catch( std::exception& e ) {
+                wlog( "lazy action decode failed: ${e}", ("e", e.what()) );
+            } catch( ... ) {
+                wlog( "lazy action decode failed" );
+            }
+            idle( examined ? busy_pause : m_idle );
+        }
+        ilog("lazy action decoder stopped");
+    }
+
+    size_t action_decoder::decode_batch() {
+        static auto& decode_latency = metrics::instance().histogram("lazy_decode");
+        static auto& decoded_rows = metrics::instance().counter("rows.lazy_decoded");
+        static auto& skipped_rows = metrics::instance().counter("rows.lazy_skipped");
+
+        std::vector<pending_row> rows;
+        rows.reserve(m_batch_size);
+        {
+            soci::rowset<soci::row> rs = m_session->rowset<soci::row>(
+                "SELECT id, account, name, data_raw, block_num FROM actions WHERE decoded = 0 ORDER BY id LIMIT :n",
+                soci::use(m_batch_size) );
+            for( const auto& r : rs ) {
+                pending_row row;
+                row.id = r.get<long long>(0);
+                row.account = r.get<std::string>(1);
+                row.name = r.get<std::string>(2);
+                row.data_raw = r.get<std::string>(3);
+                row.block_num = r.get<long long>(4);
+                rows.emplace_back( std::move(row) );
+            }
+        }
+
+        if( rows.empty() ) return 0;
+
+        scoped_latency timer(decode_latency);
+        chain::action action;
+        system_contract_arg parties;
+
+        soci::transaction tr(*m_session);
+        for( const auto& row : rows ) {
+            action.account = chain::name(row.account);
+            const auto abi = abi_cache::instance().find( m_abi_history, action.account, uint32_t(row.block_num) );
+            if( !abi ) {
+                // the account has no ABI yet, a later setabi does not apply to this row
+                m_session->execute( "UPDATE actions SET decoded = 1 WHERE id = :id", soci::use(row.id) );
+                ++skipped_rows;
+                continue;
+            }
+
+            action.name = chain::name(row.name);
+            action.data.assign( row.data_raw.begin(), row.data_raw.end() );
+
+            std::string json = "{}";
+            try {
+                json = actions_table::decode_data( action, *abi, parties );
+            } catch( ... ) {
+                // same outcome as a failed eager decode, so the row is not retried forever
+                parties = system_contract_arg();
+                wlog( "unable to decode action ${id} ${s}::${n}", ("id", row.id)("s", row.account)("n", row.name) );
+            }
+
+            m_session->execute( "UPDATE actions SET data = :da, eosto = :to, eosfrom = :form, receiver = :receiver, payer = :payer, "
+                          "newaccount = :newaccount, sellram_account = :sellram_account, decoded = 1 WHERE id = :id",
+                soci::use(json),
+                soci::use(parties.to.to_string()),
+                soci::use(parties.from.to_string()),
+                soci::use(parties.receiver.to_string()),
+                soci::use(parties.payer.to_string()),
+                soci::use(parties.name.to_string()),
+                soci::use(parties.account.to_string()),
+                soci::use(row.id) );
+            ++decoded_rows;
+        }
+        tr.commit();
+        return rows.size();
+    }
+
+} // namespace
@@ -1,24 +1,35 @@
 // #include "actions_table.hpp"
 #include <eosio/sql_db_plugin/actions_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
 
 namespace eosio {
 
-    actions_table::actions_table(std::shared_ptr<soci::session> session):
-        m_session(session) {
+    namespace {
+        // action JSON is built in place, one growable buffer per writer thread
+        std::string& json_buffer() {
+            thread_local std::string buffer;
+            return buffer;
+        }
+    }
+
+    actions_table::actions_table(std::shared_ptr<sql_session> session, std::shared_ptr<shard_router> shards):
+        m_session(session), m_shards(shards), m_abi_history(session) {
 
     }
 
     void actions_table::drop() {
         try {
-            *m_session << "drop table IF EXISTS actions_accounts";
-            *m_session << "drop table IF EXISTS actions";
+            m_session->execute( "drop table IF EXISTS actions_accounts" );
+            m_session->execute( "drop table IF EXISTS actions" );
         }catch(std::exception& e) {
             wlog(e.what());
         }
     }
 
-    void actions_table::create() {
-        *m_session << "CREATE TABLE `actions` ("
+    void actions_table::create( uint32_t blocks_per_partition ) {
+        // every unique key of a partitioned table has to include the partitioning column
+        const std::string block_key = blocks_per_partition ? ",`block_num`" : "";
+        m_session->execute( "CREATE TABLE `actions` ("
                         "`id` bigint(20) NOT NULL AUTO_INCREMENT,"
                         "`account` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`transaction_id` varchar(64) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
@@ -27,12 +38,18 @@ namespace eosio {
                         "`name` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`created_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,"
                         "`data` json DEFAULT NULL,"
+                        "`data_raw` mediumblob,"
+                        "`block_num` bigint(20) NOT NULL DEFAULT '0',"
                         "`eosto` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`eosfrom` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`receiver` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`payer` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`newaccount` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
-                        "PRIMARY KEY (`id`),"
+                        "`sellram_account` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
+                        "`global_sequence` bigint(20) unsigned DEFAULT NULL,"
+                        "`depth` tinyint(3) unsigned NOT NULL DEFAULT '0',"
+                        "`decoded` tinyint(1) NOT NULL DEFAULT '1',"
+                        "PRIMARY KEY (`id`" + block_key + "),"
                         "KEY `idx_actions_account` (`account`),"
                         "KEY `idx_actions_name` (`name`),"
                         "KEY `idx_actions_tx_id` (`transaction_id`),"
@@ -41,67 +58,59 @@ namespace eosio {
                         "KEY `idx_actions_eosfrom` (`eosfrom`),"
                         "KEY `idx_actions_receiver` (`receiver`),"
                         "KEY `idx_actions_payer` (`payer`),"
-                        "KEY `idx_actions_newaccount` (`newaccount`)"
-                        ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+                        "KEY `idx_actions_newaccount` (`newaccount`),"
+                        "KEY `idx_actions_sellram_account` (`sellram_account`),"
+                        "KEY `idx_actions_parent` (`parent`),"
+                        "KEY `idx_actions_global_sequence` (`global_sequence`),"
+                        "KEY `idx_actions_decoded` (`decoded`,`id`)"
+                        ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci" + partition_by_block(blocks_per_partition) );
 
-        *m_session << "CREATE TABLE `actions_accounts` ("
+        m_session->execute( "CREATE TABLE `actions_accounts` ("
                         "`id` bigint(20) NOT NULL AUTO_INCREMENT,"
                         "`actor` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`permission` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                         "`action_id` bigint(20) NOT NULL DEFAULT 0,"
-                        "PRIMARY KEY (`id`),"
+                        "`block_num` bigint(20) NOT NULL DEFAULT '0',"
+                        "PRIMARY KEY (`id`" + block_key + "),"
                         "KEY `idx_actions_actor` (`actor`),"
                         "KEY `idx_actions_action_id` (`action_id`)"
-                        ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+                        ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci" + partition_by_block(blocks_per_partition) );
 
     }
 
-    void actions_table::add(chain::action action, chain::transaction_id_type transaction_id, fc::time_point_sec transaction_time, uint8_t seq) {
+    void actions_table::add( const chain::action& action, const chain::account_name& receiver, const std::string& transaction_id_str, fc::time_point_sec transaction_time, uint32_t seq, uint32_t block_num,
+                             uint64_t global_sequence, uint64_t parent, uint32_t depth ) {
 
         if(action.name.to_string() == "onblock") return ; //system contract abi haven't onblock, so we could get abi_data.
 
-        chain::abi_def abi;
-        std::string abi_def_account;
-        chain::abi_serializer abis;
-        soci::indicator ind;
-        const auto transaction_id_str = transaction_id.str();
         const auto expiration = boost::chrono::seconds{transaction_time.sec_since_epoch()}.count();
 
-        string json = add_data(action);
-        system_contract_arg dataJson = fc::json::from_string(json).as<system_contract_arg>();
-        // ilog("${to} , ${from} , ${receiver} , ${name}",("to",dataJson.to.to_string())("from",dataJson.from.to_string())("receiver",dataJson.receiver.to_string())("name",dataJson.name.to_string()) );
+        auto& pending = pending_for( m_shards->shard_of(receiver) );
+        // seq is a smallint
+        seq = std::min<uint32_t>(seq, 32767);
 
-        boost::uuids::random_generator gen;
-        boost::uuids::uuid id = gen();
-        std::string action_id = boost::uuids::to_string(id);
-
-        try{
-            *m_session << "INSERT INTO actions(account, seq, created_at, name, data, transaction_id, eosto, eosfrom, receiver, payer, newaccount, sellram_account) VALUES (:ac, :se, FROM_UNIXTIME(:ca), :na, :da, :ti, :to, :form, :receiver, :payer, :newaccount, :sellram_account) ",
-                soci::use(action.account.to_string()),
-                soci::use(seq),
-                soci::use(expiration),
-                soci::use(action.name.to_string()),
-                soci::use(json),
-                soci::use(transaction_id_str),
-                soci::use(dataJson.to.to_string()),
-                soci::use(dataJson.from.to_string()),
-                soci::use(dataJson.receiver.to_string()),
-                soci::use(dataJson.payer.to_string()),
-                soci::use(dataJson.name.to_string()),
-                soci::use(dataJson.account.to_string());
-        } catch(...) {
-            wlog("insert action failed in ${n}::${a}",("n",action.account.to_string())("a",action.name.to_string()));
-            wlog("${data}",("data",fc::json::to_string(action)));
+        // setabi is always decoded, the ABI it carries is what later decoding depends on
+        const bool raw = m_data_encoding == action_data_encoding::raw && !(action.account == chain::config::system_account_name && action.name == setabi);
+        // a traced action's id is read back by its global_sequence, the others need an insert each
+        auto& rows = global_sequence ? pending.actions : pending.untraced;
+        if( raw ) {
+            add_raw( rows, action, transaction_id_str, expiration, seq, block_num );
+        } else {
+            add_decoded( rows, action, transaction_id_str, expiration, seq, block_num );
         }
+        if( global_sequence ) rows.add(global_sequence);
+        else rows.add_null();
+        rows.add(parent).add(std::min<uint32_t>(depth, 255));
+        // raw rows are what action_decoder scans for
+        rows.add( raw ? 0 : 1 );
+        pending.global_sequences.push_back( global_sequence );
 
-        for (const auto& auth : action.authorization) {
-            *m_session << "INSERT INTO actions_accounts(action_id, actor, permission) VALUES (LAST_INSERT_ID(), :ac, :pe) ",
-                    soci::use(auth.actor.to_string()),
-                    soci::use(auth.permission.to_string());
-        }
+        pending.auths.insert( pending.auths.end(), action.authorization.begin(), action.authorization.end() );
+        pending.auth_counts.push_back( action.authorization.size() );
+        pending.block_nums.push_back( block_num );
 
         try {
-            parse_actions( action );
+            if( m_account_effects ) parse_actions( action );
         } catch(std::exception& e){
             wlog(e.what());
         } catch(...){
@@ -109,41 +118,196 @@ namespace eosio {
         }
     }
 
-    void actions_table::parse_actions( chain::action action ) {
+    actions_table::pending_actions& actions_table::pending_for( size_t shard ) {
+        while( m_pending.size() <= shard ) m_pending.emplace_back( std::make_unique<pending_actions>() );
+        return *m_pending[shard];
+    }
+
+    void actions_table::add_decoded( batched_insert& rows, const chain::action& action, const std::string& transaction_id_str, int64_t expiration, uint32_t seq, uint32_t block_num ) {
+        system_contract_arg dataJson;
+        const string& json = add_data(action, dataJson, block_num);
+        // ilog("${to} , ${from} , ${receiver} , ${name}",("to",dataJson.to.to_string())("from",dataJson.from.to_string())("receiver",dataJson.receiver.to_string())("name",dataJson.name.to_string()) );
+
+        rows.row()
+            .add(action.account.to_string())
+            .add(seq)
+            .add_expr("FROM_UNIXTIME(" + std::to_string(expiration) + ")")
+            .add(action.name.to_string())
+            .add(json)
+            .add_null()
+            .add(block_num)
+            .add(transaction_id_str)
+            .add(dataJson.to.to_string())
+            .add(dataJson.from.to_string())
+            .add(dataJson.receiver.to_string())
+            .add(dataJson.payer.to_string())
+            .add(dataJson.name.to_string())
+            .add(dataJson.account.to_string());
+    }
+
+    void actions_table::add_raw( batched_insert& rows, const chain::action& action, const std::string& transaction_id_str, int64_t expiration, uint32_t seq, uint32_t block_num ) {
+        static const std::string none;
+        rows.row()
+            .add(action.account.to_string())
+            .add(seq)
+            .add_expr("FROM_UNIXTIME(" + std::to_string(expiration) + ")")
+            .add(action.name.to_string())
+            .add_null()
+            .add_blob(action.data.data(), action.data.size())
+            .add(block_num)
+            .add(transaction_id_str)
+            .add(none).add(none).add(none).add(none).add(none).add(none);
+    }
+
+    void actions_table::discard() {
+        for( auto& pending : m_pending ) {
+            pending->actions.clear();
+            pending->untraced.clear();
+            pending->accounts.clear();
+            pending->global_sequences.clear();
+            pending->auths.clear();
+            pending->auth_counts.clear();
+            pending->block_nums.clear();
+        }
+    }
+
+    void actions_table::flush() {
+        static auto& sql_latency = metrics::instance().histogram("sql.actions");
+        static auto& rows = metrics::instance().counter("rows.actions");
+
+        for( size_t shard = 0; shard < m_pending.size(); ++shard ) {
+            auto& pending = *m_pending[shard];
+            if( pending.global_sequences.empty() ) continue;
+
+            scoped_latency timer(sql_latency);
+            rows += pending.global_sequences.size();
+            auto& session = m_shards->session(shard);
+            pending.actions.flush( session );
+            pending.untraced.flush( session, &m_untraced_ids );
+            const auto traced_ids = ids_by_global_sequence( session, pending.global_sequences );
+
+            // authorizations reference the ids the actions just got
+            size_t auth = 0;
+            size_t untraced = 0;
+            for( size_t i = 0; i < pending.global_sequences.size(); ++i ) {
+                uint64_t action_id = 0;
+                if( pending.global_sequences[i] ) {
+                    auto itr = traced_ids.find( pending.global_sequences[i] );
+                    if( itr != traced_ids.end() ) action_id = itr->second;
+                } else {
+                    action_id = m_untraced_ids[untraced++];
+                }
+                for( uint32_t n = 0; n < pending.auth_counts[i]; ++n, ++auth ) {
+                    if( action_id == 0 ) continue;
+                    pending.accounts.row()
+                        .add(action_id)
+                        .add(pending.auths[auth].actor.to_string())
+                        .add(pending.auths[auth].permission.to_string())
+                        .add(pending.block_nums[i]);
+                }
+            }
+            pending.accounts.flush( session );
+
+            pending.auths.clear();
+            pending.auth_counts.clear();
+            pending.block_nums.clear();
+            pending.global_sequences.clear();
+        }
+    }
+
+    std::unordered_map<uint64_t, uint64_t> actions_table::ids_by_global_sequence( sql_session& session, const std::vector<uint64_t>& global_sequences ) {
+        // global_sequence is unique per applied action and indexed, the lists are rendered from integers
+        const size_t per_query = 1000;
+        std::unordered_map<uint64_t, uint64_t> ids;
+        std::string list;
+        size_t listed = 0;
+        const auto query = [&]() {
+            soci::rowset<soci::row> rs = session.rowset<soci::row>(
+                "SELECT CAST(global_sequence AS SIGNED), MAX(id) FROM actions WHERE global_sequence IN (" + list + ") GROUP BY global_sequence" );
+            for( const auto& r : rs ) ids[ uint64_t( r.get<long long>(0) ) ] = uint64_t( r.get<long long>(1) );
+            list.clear();
+            listed = 0;
+        };
+        for( auto global_sequence : global_sequences ) {
+            if( !global_sequence ) continue;
+            if( listed ) list += ',';
+            list += std::to_string(global_sequence);
+            if( ++listed == per_query ) query();
+        }
+        if( listed ) query();
+        return ids;
+    }
+
+    void actions_table::parse_actions( const chain::action& action ) {
         
         if(action.name == newaccount && action.account == chain::config::system_account_name) {
             auto action_data = action.data_as<chain::newaccount>();
-            *m_session << "INSERT INTO accounts (name) VALUES (:name)",
-                    soci::use(action_data.name.to_string());
+            account_dictionary::instance().intern(*m_session, action_data.name);
 
             for (const auto& key_owner : action_data.owner.keys) {
                 string permission_owner = "owner";
                 string public_key_owner = static_cast<string>(key_owner.key);
-                *m_session << "INSERT INTO accounts_keys(account, public_key, permission) VALUES (:ac, :ke, :pe) ",
+                m_shards->session_for(action_data.name).execute( "INSERT INTO accounts_keys(account, public_key, permission) VALUES (:ac, :ke, :pe) ",
                         soci::use(action_data.name.to_string()),
                         soci::use(public_key_owner),
-                        soci::use(permission_owner);
+                        soci::use(permission_owner) );
             }
 
             for (const auto& key_active : action_data.active.keys) {
                 string permission_active = "active";
                 string public_key_active = static_cast<string>(key_active.key);
-                *m_session << "INSERT INTO accounts_keys(account, public_key, permission) VALUES (:ac, :ke, :pe) ",
+                m_shards->session_for(action_data.name).execute( "INSERT INTO accounts_keys(account, public_key, permission) VALUES (:ac, :ke, :pe) ",
                         soci::use(action_data.name.to_string()),
                         soci::use(public_key_active),
-                        soci::use(permission_active);
+                        soci::use(permission_active) );
             }
 
         }
     }
 
 
-    string actions_table::add_data(chain::action action){
-        string json_str = "{}";
+    void actions_table::apply_setabi( const chain::setabi& setabi, const chain::abi_def& abi_def, const std::string& json, uint32_t block_num ) {
+        try{
+            const auto known = account_dictionary::instance().find(*m_session, setabi.account);
+            if( known ) {
+                const long long id = known->id;
+                m_session->execute( "UPDATE accounts SET abi = :abi, abi_block_num = :bn, updated_at = NOW() WHERE id = :id",soci::use(json),soci::use(block_num),soci::use(id) );
+            } else {
+                m_session->execute( "UPDATE accounts SET abi = :abi, abi_block_num = :bn, updated_at = NOW() WHERE name = :name",soci::use(json),soci::use(block_num),soci::use(setabi.account.to_string()) );
+            }
+            account_dictionary::instance().set_abi(*m_session, setabi.account, block_num);
+            m_abi_history.add(setabi.account, block_num, setabi.abi);
+            abi_cache::instance().add(setabi.account, block_num, abi_def);
+            // ilog("update abi ${n}",("n",action.account.to_string()));
+        }catch(...){
+            wlog("insert account abi failed");
+        }
+    }
+
+    void actions_table::apply_account_effects( const chain::action& action, uint32_t block_num ) {
+        if( action.account != chain::config::system_account_name ) return;
+        try {
+            if( action.name == newaccount ) {
+                parse_actions( action );
+            } else if( action.name == setabi ) {
+                const auto data = action.data_as<chain::setabi>();
+                const auto abi_def = fc::raw::unpack<chain::abi_def>(data.abi);
+                apply_setabi( data, abi_def, fc::json::to_string( abi_def ), block_num );
+            }
+        } catch(std::exception& e){
+            wlog(e.what());
+        } catch(...){
+            wlog("Unknown excpetion.");
+        }
+    }
+
+    const string& actions_table::add_data( const chain::action& action, system_contract_arg& parties, uint32_t block_num ){
+        auto& json_str = json_buffer();
 
         if(action.data.size() ==0 ){
             ilog("data size is 0.");
-             return json_str;
+            json_str = "{}";
+            return json_str;
         }
 
         try{
@@ -154,14 +318,7 @@ namespace eosio {
                     try{
                         const chain::abi_def& abi_def = fc::raw::unpack<chain::abi_def>(setabi.abi);
                         json_str = fc::json::to_string( abi_def );
-
-                        try{
-                            *m_session << "UPDATE accounts SET abi = :abi, updated_at = NOW() WHERE name = :name",soci::use(json_str),soci::use(setabi.account.to_string());
-                            // ilog("update abi ${n}",("n",action.account.to_string()));
-                        }catch(...){
-                            wlog("insert account abi failed");
-                        }
-
+                        if( m_account_effects ) apply_setabi( setabi, abi_def, json_str, block_num );
                         return json_str;
                     }catch(fc::exception& e){
                         wlog("get setabi data wrong ${e}",("e",e.what()));
@@ -169,20 +326,12 @@ namespace eosio {
                 }
             }
 
-            chain::abi_def abi;
-            std::string abi_def_account;
-            chain::abi_serializer abis;
-            soci::indicator ind;
-            //get account abi
-            *m_session << "SELECT abi FROM accounts WHERE name = :name", soci::into(abi_def_account, ind), soci::use(action.account.to_string());
+            //get account abi, as it was at this block
+            const auto abi = abi_cache::instance().find(m_abi_history, action.account, block_num);
 
-            if(!abi_def_account.empty()){
+            if(abi){
                 try {
-                    abi = fc::json::from_string(abi_def_account).as<chain::abi_def>();
-                    abis.set_abi( abi, max_serialization_time );
-                    auto binary_data = abis.binary_to_variant( abis.get_action_type(action.name), action.data, max_serialization_time);
-                    json_str = fc::json::to_string(binary_data);
-                    return json_str;
+                    return decode_data( action, *abi, parties );
                 } catch(...) {
                     wlog("unable to convert account abi to abi_def for ${s}::${n} :${abi}",("s",action.account)("n",action.name)("abi",action.data));
                     wlog("analysis data failed");
@@ -198,9 +347,48 @@ namespace eosio {
             ilog( "Unable to convert action.data to ABI: ${s}::${n}, unknown exception",
                     ("s", action.account)( "n", action.name ));
         }
+        // a failed decode may have left partial output behind
+        parties = system_contract_arg();
+        json_str = "{}";
         return json_str;
     }
 
+    const string& actions_table::decode_data( const chain::action& action, const abi_version& abi, system_contract_arg& parties ) {
+        static auto& decode_latency = metrics::instance().histogram("abi_decode");
+        static auto& json_latency = metrics::instance().histogram("json_serialize");
+
+        auto& json = json_buffer();
+        json.clear();
+        parties = system_contract_arg();
+
+        scoped_latency timer(decode_latency);
+        const auto type = abi.writer.action_type(action.name);
+        if( !type.empty() ) {
+            auto on_name = [&parties]( const string& field, const chain::name& value ) {
+                if( field == "to" ) parties.to = value;
+                else if( field == "from" ) parties.from = value;
+                else if( field == "receiver" ) parties.receiver = value;
+                else if( field == "payer" ) parties.payer = value;
+                else if( field == "name" ) parties.name = value;
+                else if( field == "account" ) parties.account = value;
+            };
+            if( abi.writer.write( type, action.data, json, on_name ) ) return json;
+        }
+
+        // types the streaming writer does not cover go through abi_serializer and a re-parse
+        const auto binary_data = abi.serializer.binary_to_variant( abi.serializer.get_action_type(action.name), action.data, abi.max_serialization_time );
+        {
+            scoped_latency timer(json_latency);
+            json = fc::json::to_string(binary_data);
+        }
+        parties = participants(json);
+        return json;
+    }
+
+    system_contract_arg actions_table::participants( const string& json ) {
+        return fc::json::from_string(json).as<system_contract_arg>();
+    }
+
     const chain::account_name actions_table::newaccount = chain::newaccount::get_name();
     const chain::account_name actions_table::setabi = chain::setabi::get_name();
 
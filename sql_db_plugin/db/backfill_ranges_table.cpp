@@ -0,0 +1,52 @@
+#include <eosio/sql_db_plugin/backfill_ranges_table.hpp>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    backfill_ranges_table::backfill_ranges_table( std::shared_ptr<sql_session> session ):
+        m_session(session) {
+
+    }
+
+    void backfill_ranges_table::drop() {
+        try {
+            m_session->execute( "DROP TABLE IF EXISTS backfill_ranges" );
+        }
+        catch(std::exception& e){
+            wlog(e.what());
+        }
+    }
+
+    void backfill_ranges_table::create() {
+        m_session->execute( "CREATE TABLE `backfill_ranges` ("
+                "`pass` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`first_block` bigint(20) NOT NULL DEFAULT '0',"
+                "`last_block` bigint(20) NOT NULL DEFAULT '0',"
+                "`block_num` bigint(20) NOT NULL DEFAULT '0',"
+                "`updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,"
+                "PRIMARY KEY (`pass`,`first_block`,`last_block`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+    }
+
+    void backfill_ranges_table::set( const backfill_range& range, uint32_t block_num ) {
+        m_session->execute( "INSERT INTO backfill_ranges(pass, first_block, last_block, block_num) VALUES (:p, :f, :l, :bn) "
+                    "ON DUPLICATE KEY UPDATE block_num = VALUES(block_num)",
+            soci::use(range.pass),
+            soci::use(range.first),
+            soci::use(range.last),
+            soci::use(block_num) );
+    }
+
+    uint32_t backfill_ranges_table::get( const backfill_range& range ) {
+        long long block_num = 0;
+        soci::indicator ind = soci::i_null;
+        m_session->execute( "SELECT block_num FROM backfill_ranges WHERE pass = :p AND first_block = :f AND last_block = :l",
+            soci::into(block_num, ind),
+            soci::use(range.pass),
+            soci::use(range.first),
+            soci::use(range.last) );
+        return ind == soci::i_ok ? static_cast<uint32_t>(block_num) : 0;
+    }
+
+} // namespace
@@ -0,0 +1,131 @@
+#include <eosio/sql_db_plugin/batched_insert.hpp>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    batched_insert::batched_insert( std::string head, std::string tail, size_t max_statement_bytes ):
+        m_head( std::move(head) ), m_tail( std::move(tail) ), m_max_statement_bytes(max_statement_bytes) {
+    }
+
+    batched_insert& batched_insert::row() {
+        if( m_row_open ) close_row();
+        m_values += '(';
+        m_row_ends.push_back( m_values.size() );
+        m_row_params.push_back( m_params.size() );
+        m_row_bytes.push_back( m_values.size() + m_param_bytes );
+        m_row_open = true;
+        return *this;
+    }
+
+    void batched_insert::close_row() {
+        m_values += ')';
+        m_row_ends.back() = m_values.size();
+        m_row_params.back() = m_params.size();
+        m_row_bytes.back() = m_values.size() + m_param_bytes;
+        m_row_open = false;
+    }
+
+    void batched_insert::separate() {
+        if( m_values.back() != '(' ) m_values += ',';
+    }
+
+    batched_insert& batched_insert::add( const std::string& text ) {
+        separate();
+        m_values += ":v";
+        m_values += std::to_string( m_params.size() );
+        m_params.push_back( text );
+        m_param_bytes += text.size();
+        return *this;
+    }
+
+    batched_insert& batched_insert::add_blob( const char* data, size_t size ) {
+        static const char digits[] = "0123456789ABCDEF";
+        separate();
+        if( size == 0 ) {
+            m_values += "''";
+            return *this;
+        }
+        m_values += "X'";
+        for( size_t i = 0; i < size; ++i ) {
+            auto c = static_cast<unsigned char>(data[i]);
+            m_values += digits[c >> 4];
+            m_values += digits[c & 0x0f];
+        }
+        m_values += '\'';
+        return *this;
+    }
+
+    batched_insert& batched_insert::add_null() {
+        return add_expr("NULL");
+    }
+
+    batched_insert& batched_insert::add_expr( const std::string& sql ) {
+        separate();
+        m_values += sql;
+        return *this;
+    }
+
+    void batched_insert::flush( sql_session& session, std::vector<uint64_t>* ids ) {
+        if( m_row_open ) close_row();
+        if( ids ) {
+            ids->assign( m_row_ends.size(), 0 );
+            for( size_t i = 0; i < m_row_ends.size(); ++i ) execute( session, i, i + 1, ids );
+            clear();
+            return;
+        }
+
+        size_t first = 0;
+        while( first < m_row_ends.size() ) {
+            size_t last = first + 1;
+            // bound text is part of the statement the server receives
+            const auto start = first ? m_row_bytes[first - 1] : 0;
+            while( last < m_row_ends.size() && m_row_bytes[last] - start <= m_max_statement_bytes ) ++last;
+            execute( session, first, last, ids );
+            first = last;
+        }
+
+        clear();
+    }
+
+    void batched_insert::clear() {
+        m_values.clear();
+        m_row_ends.clear();
+        m_params.clear();
+        m_row_params.clear();
+        m_row_bytes.clear();
+        m_param_bytes = 0;
+        m_row_open = false;
+    }
+
+    void batched_insert::execute( sql_session& session, size_t first, size_t last, std::vector<uint64_t>* ids ) {
+        m_statement = m_head;
+        for( size_t i = first; i < last; ++i ) {
+            if( i > first ) m_statement += ',';
+            m_statement.append( row_begin(i), m_values.data() + m_row_ends[i] );
+        }
+        m_statement += m_tail;
+        const auto params_begin = first ? m_row_params[first - 1] : 0;
+
+        try {
+            session.execute_values( m_statement, m_params.data() + params_begin, m_row_params[last - 1] - params_begin );
+            if( ids ) {
+                // a single row statement, flush() asks for ids one row at a time
+                long long id = 0;
+                session.execute( "SELECT LAST_INSERT_ID()", soci::into(id) );
+                (*ids)[first] = uint64_t(id);
+            }
+            return;
+        } catch( std::exception& e ) {
+            // a transient error counted toward the session's failures and the block is redone as a
+            // whole; any other did not, so rows retried here that succeed leave nothing failed
+            if( last - first == 1 || sql_session::is_transient(e) ) {
+                wlog( "insert of ${n} rows failed: ${e}", ("n", last - first)("e", e.what()) );
+                return;
+            }
+            wlog( "batched insert of ${n} rows failed, retrying them one by one: ${e}", ("n", last - first)("e", e.what()) );
+        }
+        for( size_t i = first; i < last; ++i ) execute( session, i, i + 1, ids );
+    }
+
+} // namespace
@@ -1,18 +1,19 @@
 // #include "blocks_table.hpp"
 #include <eosio/sql_db_plugin/blocks_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
 
 #include <fc/log/logger.hpp>
 
 namespace eosio {
 
-    blocks_table::blocks_table(std::shared_ptr<soci::session> session):
+    blocks_table::blocks_table(std::shared_ptr<sql_session> session):
             m_session(session) {
 
     }
 
     void blocks_table::drop() {
         try {
-            *m_session << "DROP TABLE IF EXISTS blocks";
+            m_session->execute( "DROP TABLE IF EXISTS blocks" );
         }
         catch(std::exception& e){
             wlog(e.what());
@@ -20,7 +21,7 @@ namespace eosio {
     }
 
     void blocks_table::create() {
-        *m_session << "CREATE TABLE blocks("
+        m_session->execute( "CREATE TABLE blocks("
                 "id VARCHAR(64) PRIMARY KEY,"
                 "block_number INT NOT NULL AUTO_INCREMENT,"
                 "prev_block_id VARCHAR(64),"
@@ -33,28 +34,71 @@ namespace eosio {
                 "new_producers JSON DEFAULT NULL,"
                 "num_transactions INT DEFAULT 0,"
                 "confirmed INT,"
-                "UNIQUE KEY block_number (block_number)) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE utf8mb4_general_ci;";
+                "UNIQUE KEY block_number (block_number)) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE utf8mb4_general_ci;" );
 
-        *m_session << "CREATE INDEX idx_blocks_producer ON blocks (producer);";
-        *m_session << "CREATE INDEX idx_blocks_number ON blocks (block_number);";
+        m_session->execute( "CREATE INDEX idx_blocks_producer ON blocks (producer);" );
+        m_session->execute( "CREATE INDEX idx_blocks_number ON blocks (block_number);" );
 
     }
 
 
 
-    void blocks_table::add( const chain::block_state_ptr&  bs ) {
-        auto block = bs->block;
+    void blocks_table::add( const chain::block_state_ptr& bs, bool irreversible ) {
+        insert( "blocks", bs->block, bs->trxs.size(), irreversible );
+    }
+
+    void blocks_table::add( const chain::signed_block_ptr& block, bool irreversible ) {
+        insert( "blocks", block, block->transactions.size(), irreversible );
+    }
+
+    void blocks_table::add_reversible( const chain::block_state_ptr& bs ) {
+        insert( "reversible_blocks", bs->block, bs->trxs.size(), false );
+    }
+
+    void blocks_table::remove_reversible( const std::vector<std::string>& block_ids ) {
+        if( block_ids.empty() ) return;
+        std::string block_id;
+        auto st = m_session->prepare_timed( "DELETE FROM reversible_blocks WHERE block_id = :id", soci::use(block_id) );
+        for( const auto& id : block_ids ) {
+            block_id = id;
+            st.execute(true);
+        }
+    }
+
+    void blocks_table::remove( const std::vector<std::string>& block_ids ) {
+        if( block_ids.empty() ) return;
+        std::string block_id;
+        auto st = m_session->prepare_timed( "DELETE FROM blocks WHERE irreversible = 0 AND block_id = :id", soci::use(block_id) );
+        for( const auto& id : block_ids ) {
+            block_id = id;
+            st.execute(true);
+        }
+    }
+
+    void blocks_table::prune_reversible( uint32_t irreversible_block_num ) {
+        try{
+            m_session->execute( "DELETE FROM reversible_blocks WHERE block_number <= :bn", soci::use(irreversible_block_num) );
+        } catch(std::exception& e) {
+            wlog( "prune reversible blocks failed. ${n} ${e}",("n",irreversible_block_num)("e",e.what()) );
+        }
+    }
+
+    void blocks_table::insert( const std::string& table, const chain::signed_block_ptr& block, size_t trx_count, bool irreversible ) {
         const auto block_id_str = block->id().str();
         const auto previous_block_id_str = block->previous.str();
         const auto transaction_mroot_str = block->transaction_mroot.str();
         const auto action_mroot_str = block->action_mroot.str();
         const auto timestamp = std::chrono::seconds{block->timestamp.operator fc::time_point().sec_since_epoch()}.count();
-        const auto num_transactions = (int)bs->trxs.size();
+        const auto num_transactions = (int)trx_count;
 
+        static auto& sql_latency = metrics::instance().histogram("sql.blocks");
+        static auto& rows = metrics::instance().counter("rows.blocks");
+        scoped_latency timer(sql_latency);
+        ++rows;
 
         try{
-            *m_session << "REPLACE INTO blocks(block_id, block_number, prev_block_id, timestamp, transaction_merkle_root, action_merkle_root,"
-                "producer, version, confirmed, num_transactions) VALUES (:id, :in, :pb, FROM_UNIXTIME(:ti), :tr, :ar, :pa, :ve, :pe, :nt)",
+            m_session->execute( "REPLACE INTO " + table + "(block_id, block_number, prev_block_id, timestamp, transaction_merkle_root, action_merkle_root,"
+                "producer, version, confirmed, num_transactions, irreversible) VALUES (:id, :in, :pb, FROM_UNIXTIME(:ti), :tr, :ar, :pa, :ve, :pe, :nt, :ir)",
                 soci::use(block_id_str),
                 soci::use(block->block_num()),
                 soci::use(previous_block_id_str),
@@ -64,13 +108,14 @@ namespace eosio {
                 soci::use(block->producer.to_string()),
                 soci::use(block->schedule_version),
                 soci::use(block->confirmed),
-                soci::use(num_transactions);
+                soci::use(num_transactions),
+                soci::use(irreversible?1:0) );
 
             if (block->new_producers) {
                 const auto new_producers = fc::json::to_string(block->new_producers->producers);
-                *m_session << "UPDATE blocks SET new_producers = :np WHERE block_id = :id",
+                m_session->execute( "UPDATE " + table + " SET new_producers = :np WHERE block_id = :id",
                         soci::use(new_producers),
-                        soci::use(block_id_str);
+                        soci::use(block_id_str) );
             }
         } catch(std::exception e) {
             wlog( "add blocks failed. ${e}",("e",e.what()) );
@@ -79,18 +124,25 @@ namespace eosio {
         }
     }
 
+    bool blocks_table::exists( const std::string& block_id ) {
+        int amount = 0;
+        m_session->execute( "SELECT COUNT(*) FROM blocks WHERE block_id = :id", soci::into(amount), soci::use(block_id) );
+        return amount > 0;
+    }
+
     bool blocks_table::irreversible_set( std::string block_id, bool irreversible ){
         int amount = 0;
         try{
-            soci::statement st = ( m_session->prepare << "UPDATE blocks SET irreversible = :irreversible WHERE block_id = :id",
-                    soci::use(irreversible?1:0),
+            const int irreversible_value = irreversible ? 1 : 0;
+            auto st = m_session->prepare_timed( "UPDATE blocks SET irreversible = :irreversible WHERE block_id = :id",
+                    soci::use(irreversible_value),
                     soci::use(block_id) );
             st.execute(true);
             amount = st.get_affected_rows();
             if(amount==0){
-                *m_session << "select count(*) from blocks where irreversible = 0 and block_id = :id ",
+                m_session->execute( "select count(*) from blocks where irreversible = 0 and block_id = :id ",
                     soci::into(amount),
-                    soci::use(block_id);
+                    soci::use(block_id) );
                 if(amount==0) return true;
             }
             // wlog( "${amount}",("amount",amount) );
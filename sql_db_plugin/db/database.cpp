@@ -1,16 +1,108 @@
 // #include "database.hpp"
 #include <eosio/sql_db_plugin/database.hpp>
 
+#include <set>
+
 namespace eosio
 {
 
+    namespace {
+        // beyond this a block's scratch is released instead of kept for the next one
+        const size_t max_retained_actions = 256;
+        const size_t max_retained_bytes = 64 * 1024;
+        // re-check for rows of the other stream at least this often, notifications aside
+        const fc::microseconds poll_interval = fc::milliseconds(100);
+    }
+
+    const chain::transaction& block_scratch::unpack( const chain::packed_transaction& packed ) {
+        m_raw = packed.get_raw_transaction();
+        fc::datastream<const char*> ds( m_raw.data(), m_raw.size() );
+        fc::raw::unpack( ds, m_trx );
+        return m_trx;
+    }
+
+    void block_scratch::reset() {
+        if( m_trx.actions.capacity() > max_retained_actions ) std::vector<chain::action>().swap( m_trx.actions );
+        if( m_raw.capacity() > max_retained_bytes ) chain::bytes().swap( m_raw );
+    }
+
+    size_t decoded_block::prepare() {
+        const auto size = block->block->transactions.size();
+        trxs.resize(size);
+        decoded.assign(size, 0);
+        return size;
+    }
+
+    void decoded_block::decode( size_t begin, size_t end ) {
+        const auto& receipts = block->block->transactions;
+        for( size_t i = begin; i < end && i < receipts.size(); ++i ) {
+            if( !receipts[i].trx.contains<chain::packed_transaction>() ) continue;
+            const auto raw = receipts[i].trx.get<chain::packed_transaction>().get_raw_transaction();
+            fc::datastream<const char*> ds( raw.data(), raw.size() );
+            fc::raw::unpack( ds, trxs[i] );
+            decoded[i] = 1;
+        }
+    }
+
+    const chain::transaction* decoded_block::find( size_t i ) const {
+        return i < decoded.size() && decoded[i] ? &trxs[i] : nullptr;
+    }
+
+    bool decoded_block::complete() const {
+        const auto& receipts = block->block->transactions;
+        if( decoded.size() != receipts.size() ) return false;
+        for( size_t i = 0; i < receipts.size(); ++i ) {
+            if( receipts[i].trx.contains<chain::packed_transaction>() && !decoded[i] ) return false;
+        }
+        return true;
+    }
+
+    void write_progress::notify() {
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            ++m_version;
+        }
+        m_cond.notify_all();
+    }
+
+    bool write_progress::wait( fc::microseconds timeout ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        const auto version = m_version;
+        const auto deadline = boost::get_system_time() + boost::posix_time::microseconds( timeout.count() );
+        while( !m_stopped && m_version == version ) {
+            if( !m_cond.timed_wait( lock, deadline ) ) break;
+        }
+        return !m_stopped;
+    }
+
+    void write_progress::stop() {
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            m_stopped = true;
+        }
+        m_cond.notify_all();
+    }
+
+    bool write_progress::stopped() {
+        boost::mutex::scoped_lock lock(m_mtx);
+        return m_stopped;
+    }
+
     database::database(const std::string &uri, uint32_t block_num_start) {
-        m_session = std::make_shared<soci::session>(uri); 
+        m_session = std::make_shared<sql_session>(uri);
+        m_shards = std::make_shared<shard_router>(m_session);
         m_accounts_table = std::make_unique<accounts_table>(m_session);
         m_blocks_table = std::make_unique<blocks_table>(m_session);
-        m_traces_table = std::make_unique<traces_table>(m_session);
+        m_traces_table = std::make_unique<traces_table>(m_session, m_shards);
         m_transactions_table = std::make_unique<transactions_table>(m_session);
-        m_actions_table = std::make_unique<actions_table>(m_session);
+        m_actions_table = std::make_unique<actions_table>(m_session, m_shards);
+        m_sync_state_table = std::make_unique<sync_state_table>(m_session);
+        m_backfill_ranges = std::make_unique<backfill_ranges_table>(m_session);
+        m_rollups = std::make_shared<rollups_table>(m_session);
+        m_traces_table->set_rollups(m_rollups);
+        m_voter_producers = std::make_shared<voter_producers_table>(m_shards);
+        m_traces_table->set_voter_producers(m_voter_producers);
+        account_dictionary::instance().load(*m_session);
         m_block_num_start = block_num_start;
         system_account = chain::name(chain::config::system_account_name).to_string();
     }
@@ -37,71 +129,207 @@ namespace eosio
         return m_accounts_table->exist(system_account);
     }
 
-    void database::consume_block_state( const chain::block_state_ptr& bs) {
-        //TODO
-        m_blocks_table->add(bs);
+    uint32_t database::last_checkpoint() {
+        return m_shards->watermark( m_sync_state_table->get() );
     }
 
-    void database::consume_irreversible_block_state( const chain::block_state_ptr& bs, boost::mutex::scoped_lock& lock_db, boost::condition_variable& condition,boost::atomic<bool>& exit){
-        //TODO
-        // ilog("run consume irreversible block");
-        auto block_id = bs->id.str();
-        do{
-            bool update_irreversible = m_blocks_table->irreversible_set(block_id, true);
-            if(update_irreversible || exit) break;
-            else condition.timed_wait(lock_db, boost::posix_time::milliseconds(100));
-        }while(!exit);
-
-        for(auto& receipt : bs->block->transactions) {
-            string trx_id_str;
-            if( receipt.trx.contains<chain::packed_transaction>() ){
-                const auto& trx = fc::raw::unpack<chain::transaction>( receipt.trx.get<chain::packed_transaction>().get_raw_transaction() );
+    void database::checkpoint( uint32_t block_num, const std::string& block_id ) {
+        m_sync_state_table->set(block_num, block_id);
+    }
 
-                if(trx.actions.size()==1 && trx.actions[0].name.to_string() == "onblock" ) continue ;
+    void database::set_reversible_buffer( std::shared_ptr<reversible_block_buffer> buffer, bool buffer_blocks, bool mirror_head_window ) {
+        m_reversible_buffer = std::move(buffer);
+        m_buffer_blocks = buffer_blocks;
+        m_mirror_head_window = mirror_head_window;
+    }
 
-                // ilog("run irreversible");
+    void database::set_trace_encoding( trace_encoding encoding ) {
+        m_traces_table->set_encoding(encoding);
+    }
 
-                m_transactions_table->add(trx);
-                for(auto actions : trx.actions){
-                    uint8_t seq = 0;
-                    m_actions_table->add(actions,trx.id(), trx.expiration, seq);
-                    seq++;
-                }  
+    void database::set_action_data_encoding( action_data_encoding encoding ) {
+        m_actions_table->set_data_encoding(encoding);
+    }
 
-                trx_id_str = trx.id().str();
+    void database::set_token_schema( token_schema schema ) {
+        m_traces_table->set_token_schema(schema);
+    }
 
-                bool trace_result;
-                do{
-                    trace_result = m_traces_table->list(trx_id_str, bs->block->timestamp);
-                    if(trace_result || exit) break;
-                    else condition.timed_wait(lock_db, boost::posix_time::milliseconds(100));     
-                }while((!exit));
+    void database::set_partitioning( uint32_t blocks_per_partition, uint32_t ahead, uint32_t retain ) {
+        m_partitions.clear();
+        for( size_t shard = 0; shard < m_shards->size(); ++shard ) {
+            m_partitions.emplace_back( std::make_unique<partition_manager>(m_shards->shared_session(shard), blocks_per_partition, ahead, retain) );
+        }
+    }
 
-            }else{
-                trx_id_str = receipt.trx.get<chain::transaction_id_type>().str();
-            }
+    void database::set_shards( const std::vector<std::string>& uris ) {
+        for( const auto& uri : uris ) {
+            m_shards->add_shard( std::make_shared<sql_session>(uri) );
+        }
+    }
+
+    void database::consume_block_state( const chain::block_state_ptr& bs) {
+        if( !m_reversible_buffer ) {
+            m_blocks_table->add(bs);
+            return;
+        }
 
-            auto ir_trans = m_transactions_table->find_transaction(trx_id_str);
+        auto dropped = m_reversible_buffer->add(bs);
+        if( !dropped.empty() ) rollback(bs, dropped);
 
-            if(ir_trans){
-                m_transactions_table->irreversible_set(block_id, true, trx_id_str);
-            }
+        // buffered mode: blocks are written once, by the irreversible writer
+        if( !m_buffer_blocks ) {
+            m_blocks_table->add(bs);
+        } else if( m_mirror_head_window ) {
+            m_blocks_table->add_reversible(bs);
+        }
+    }
+
+    void database::rollback( const chain::block_state_ptr& head, const std::vector<reversible_block>& dropped ) {
+        // the fork is seen at the first block of the new branch, whose traces are the only ones staged
+        // since; one it re-applied at the dropped block's height carries the same block_num and stays
+        std::set<chain::transaction_id_type> restaged;
+        for( const auto& tm : head->trxs ) restaged.insert(tm->id);
+
+        std::vector<std::string> block_ids;
+        std::vector<std::string> trace_ids;
+        size_t traces = 0;
 
+        // the reversible writer fills blocks (or reversible_blocks) and traces, nothing else to undo;
+        // a failure throws before the commit and leaves the rows for the operator rather than half of them
+        soci::transaction tr(*m_session);
+        for( const auto& rb : dropped ) {
+            block_ids.emplace_back( rb.id.str() );
+            trace_ids.clear();
+            for( const auto& id : rb.trx_ids ) {
+                if( rb.block_num != head->block_num || restaged.count(id) == 0 ) trace_ids.emplace_back( id.str() );
+            }
+            m_traces_table->remove( rb.block_num, trace_ids );
+            traces += trace_ids.size();
+        }
+        if( !m_buffer_blocks ) {
+            m_blocks_table->remove(block_ids);
+        } else if( m_mirror_head_window ) {
+            m_blocks_table->remove_reversible(block_ids);
         }
+        tr.commit();
+
+        ilog( "fork switch at block ${n}, rolled back ${b} blocks and ${t} staged traces",
+              ("n", head->block_num)("b", block_ids.size())("t", traces) );
+    }
 
+    void database::discard_pending() {
+        m_transactions_table->discard();
+        m_actions_table->discard();
+        m_rollups->discard();
+        m_voter_producers->discard();
+        m_traces_table->discard();
+        account_dictionary::instance().discard(*m_session);
+        abi_cache::instance().discard();
+    }
+
+    bool database::wait_for_staged_rows( const std::string& block_id, const std::vector<std::string>& trx_ids, write_progress& progress ) {
+        // autocommit reads, each one sees whatever the reversible writer has committed by then
+        bool block_written = m_buffer_blocks;
+        size_t staged = 0;
+        for( ;; ) {
+            if( !block_written ) block_written = m_blocks_table->exists(block_id);
+            while( staged < trx_ids.size() && (trx_ids[staged].empty() || m_traces_table->staged(trx_ids[staged])) ) ++staged;
+            if( block_written && staged == trx_ids.size() ) return true;
+            if( !progress.wait(poll_interval) ) return false;
+        }
     }
 
-    void database::consume_transaction_metadata( const chain::transaction_metadata_ptr& tm ) {
+    bool database::consume_irreversible_block_state( const decoded_block& decoded, write_progress& progress ){
+        const auto& bs = decoded.block;
+        auto block_id = bs->id.str();
+        const auto& receipts = bs->block->transactions;
+
+        // ids of the transactions whose staged trace is applied, empty for the others
+        std::vector<std::string> trx_ids( receipts.size() );
+        for( size_t i = 0; i < receipts.size(); ++i ) {
+            if( !receipts[i].trx.contains<chain::packed_transaction>() ) continue;
+            const auto* predecoded = decoded.find(i);
+            const auto& trx = predecoded ? *predecoded : m_scratch.unpack( receipts[i].trx.get<chain::packed_transaction>() );
+            if(trx.actions.size()==1 && trx.actions[0].name.to_string() == "onblock" ) continue ;
+            trx_ids[i] = trx.id().str();
+        }
+
+        // waited for before the transaction opens, no locks are held while the reversible writer catches up
+        if( !wait_for_staged_rows( block_id, trx_ids, progress ) ) {
+            wlog( "irreversible block ${n} interrupted by shutdown, not checkpointed", ("n", bs->block_num) );
+            return false;
+        }
+
+        // the block and its sync_state checkpoint commit together, an interrupted block is redone on restart
+        const auto failures = m_shards->failures();
+        soci::transaction tr(*m_session);
+        shard_router::transaction shard_tr(*m_shards);
+        // rows queued by a block that threw or was interrupted must not land with this one
+        discard_pending();
 
-        if(tm->trx.actions.size()==1 && tm->trx.actions[0].name.to_string() == "onblock" ) return ;
+        if( m_reversible_buffer ) m_reversible_buffer->prune(bs->block_num);
+
+        if( m_buffer_blocks ) {
+            m_blocks_table->add(bs, true);
+            if( m_mirror_head_window ) m_blocks_table->prune_reversible(bs->block_num);
+        } else {
+            m_blocks_table->irreversible_set(block_id, true);
+        }
+
+        for( size_t i = 0; i < receipts.size(); ++i ) {
+            const auto& receipt = receipts[i];
+            if( receipt.trx.contains<chain::packed_transaction>() ){
+                if( trx_ids[i].empty() ) continue;
+                const auto& trx_id_str = trx_ids[i];
+                const auto* predecoded = decoded.find(i);
+                const auto& trx = predecoded ? *predecoded : m_scratch.unpack( receipt.trx.get<chain::packed_transaction>() );
+
+                // actions come from the trace, inline ones included, in the pass that applies it
+                const auto add_action = [&]( const flattened_action& action ) {
+                    m_actions_table->add(action.trace.act, action.trace.receipt.receiver, trx_id_str, trx.expiration, action.ordinal, bs->block_num,
+                                         action.trace.receipt.global_sequence, action.parent, action.depth);
+                };
+
+                transaction_usage usage(receipt);
+                fc::microseconds elapsed;
+                FC_ASSERT( m_traces_table->list(trx_id_str, bs->block_num, bs->block->timestamp, &elapsed, add_action),
+                           "staged trace of ${id} in block ${n} is gone", ("id", trx_id_str)("n", bs->block_num) );
+                usage.elapsed = elapsed;
+
+                // written irreversible right away, no lookup and update round trips below
+                m_transactions_table->add(trx, trx_id_str, bs->block_num, block_id, true, &usage);
+
+            }else{
+                const auto trx_id_str = receipt.trx.get<chain::transaction_id_type>().str();
+
+                auto ir_trans = m_transactions_table->find_transaction(trx_id_str);
+
+                if(ir_trans){
+                    m_transactions_table->irreversible_set(block_id, bs->block_num, trx_id_str, transaction_usage(receipt));
+                }
+            }
 
-        m_transactions_table->add(tm->trx);
-        for(auto actions : tm->trx.actions){
-            uint8_t seq = 0;
-            m_actions_table->add(actions,tm->trx.id(), tm->trx.expiration, seq);
-            seq++;
         }
 
+        m_rollups->add_block(bs->header.producer, bs->header.timestamp, bs->block->transactions.size());
+        m_transactions_table->flush();
+        m_actions_table->flush();
+        m_rollups->flush();
+        m_voter_producers->flush();
+        // tables log and carry on past a failed statement; one that a retry of the block can get
+        // past is not left behind with its rows missing, the others stay logged as before
+        FC_ASSERT( m_shards->failures() == failures, "${f} statements of irreversible block ${n} failed transiently",
+                   ("f", m_shards->failures() - failures)("n", bs->block_num) );
+        shard_tr.commit(bs->block_num, block_id);
+        m_sync_state_table->set(bs->block_num, block_id);
+        tr.commit();
+        m_voter_producers->committed();
+        account_dictionary::instance().committed(*m_session);
+        abi_cache::instance().committed();
+        m_scratch.reset();
+        for( auto& partitions : m_partitions ) partitions->maintain(bs->block_num);
+        return true;
     }
 
     void database::consume_transaction_trace( const chain::transaction_trace_ptr& tt) {
@@ -115,6 +343,95 @@ namespace eosio
         m_traces_table->add(tt);
     }
 
+    void database::consume_transaction_trace( const chain::transaction_trace_ptr& tt, const std::string& encoded ) {
+        m_traces_table->add(tt, encoded);
+    }
+
+    std::string database::encode_transaction_trace( const chain::transaction_trace& tt ) const {
+        return m_traces_table->encode_staged(tt);
+    }
+
+    uint32_t database::backfill_progress( const backfill_range& range ) {
+        return m_backfill_ranges->get(range);
+    }
+
+    void database::set_account_effects( bool apply ) {
+        m_actions_table->set_account_effects(apply);
+    }
+
+    void database::consume_account_effects( const std::vector<chain::signed_block_ptr>& blocks, const backfill_range& range ) {
+        soci::transaction tr(*m_session);
+        discard_pending();
+
+        for( const auto& block : blocks ) {
+            for( const auto& receipt : block->transactions ) {
+                if( !receipt.trx.contains<chain::packed_transaction>() ) continue;
+                const auto& trx = m_scratch.unpack( receipt.trx.get<chain::packed_transaction>() );
+                for( const auto& action : trx.actions ) m_actions_table->apply_account_effects(action, block->block_num());
+            }
+        }
+
+        if( !blocks.empty() ) m_backfill_ranges->set( range, blocks.back()->block_num() );
+        tr.commit();
+        account_dictionary::instance().committed(*m_session);
+        abi_cache::instance().committed();
+        m_scratch.reset();
+    }
+
+    void database::consume_signed_blocks( const std::vector<chain::signed_block_ptr>& blocks, bool with_staged_traces, const backfill_range& range ) {
+        soci::transaction tr(*m_session);
+        shard_router::transaction shard_tr(*m_shards);
+        discard_pending();
+
+        for( const auto& block : blocks ) {
+            const auto block_id = block->id().str();
+            m_blocks_table->add(block, true);
+            m_rollups->add_block(block->producer, block->timestamp, block->transactions.size());
+
+            for( const auto& receipt : block->transactions ) {
+                if( !receipt.trx.contains<chain::packed_transaction>() ) continue;
+
+                const auto& trx = m_scratch.unpack( receipt.trx.get<chain::packed_transaction>() );
+                if( trx.actions.size()==1 && trx.actions[0].name.to_string() == "onblock" ) continue;
+
+                const auto trx_id_str = trx.id().str();
+                const auto add_action = [&]( const flattened_action& action ) {
+                    m_actions_table->add(action.trace.act, action.trace.receipt.receiver, trx_id_str, trx.expiration, action.ordinal, block->block_num(),
+                                         action.trace.receipt.global_sequence, action.parent, action.depth);
+                };
+
+                transaction_usage usage(receipt);
+                fc::microseconds elapsed;
+                bool traced = with_staged_traces && m_traces_table->list(trx_id_str, block->block_num(), block->timestamp, &elapsed, add_action);
+                if( traced ) {
+                    usage.elapsed = elapsed;
+                } else {
+                    if( with_staged_traces ) wlog( "no staged trace for ${id} in block ${n}", ("id", trx_id_str)("n", block->block_num()) );
+                    // top level actions only, their tree position unknown
+                    uint32_t seq = 0;
+                    for( const auto& action : trx.actions ) {
+                        m_actions_table->add(action, action.account, trx_id_str, trx.expiration, seq++, block->block_num());
+                    }
+                }
+                m_transactions_table->add(trx, trx_id_str, block->block_num(), block_id, true, &usage);
+            }
+        }
+
+        m_transactions_table->flush();
+        m_actions_table->flush();
+        m_rollups->flush();
+        m_voter_producers->flush();
+        if( !blocks.empty() ) {
+            shard_tr.commit( blocks.back()->block_num(), blocks.back()->id().str() );
+            m_backfill_ranges->set( range, blocks.back()->block_num() );
+        }
+        tr.commit();
+        m_voter_producers->committed();
+        account_dictionary::instance().committed(*m_session);
+        abi_cache::instance().committed();
+        m_scratch.reset();
+    }
+
     const std::string database::block_states_col = "block_states";
     const std::string database::blocks_col = "blocks";
     const std::string database::trans_col = "transactions";
@@ -0,0 +1,66 @@
+#include <eosio/sql_db_plugin/json_writer.hpp>
+
+namespace eosio {
+
+    void json_writer::write( const std::string& v ) {
+        for( unsigned char c : v ) {
+            // escapes, control characters and non-ASCII (which fc validates) take fc's path
+            if( c < 0x20 || c >= 0x7f || c == '"' || c == '\\' ) {
+                m_out += fc::json::to_string( fc::variant(v) );
+                return;
+            }
+        }
+        write_plain(v);
+    }
+
+    void json_writer::write( const chain::name& v ) {
+        write_plain( v.to_string() );
+    }
+
+    void json_writer::write( const fc::sha256& v ) {
+        write_hex( v.data(), v.data_size() );
+    }
+
+    void json_writer::write( const std::vector<char>& v ) {
+        write_hex( v.data(), v.size() );
+    }
+
+    void json_writer::write_int( int64_t v ) {
+        // fc::json stringifies integers a javascript double could not hold
+        if( v > int64_t(0xffffffff) || v < -int64_t(0xffffffff) ) {
+            m_out += '"';
+            m_out += std::to_string(v);
+            m_out += '"';
+        } else {
+            m_out += std::to_string(v);
+        }
+    }
+
+    void json_writer::write_uint( uint64_t v ) {
+        if( v > 0xffffffff ) {
+            m_out += '"';
+            m_out += std::to_string(v);
+            m_out += '"';
+        } else {
+            m_out += std::to_string(v);
+        }
+    }
+
+    void json_writer::write_plain( const std::string& v ) {
+        m_out += '"';
+        m_out += v;
+        m_out += '"';
+    }
+
+    void json_writer::write_hex( const char* data, size_t size ) {
+        static const char digits[] = "0123456789abcdef";
+        m_out += '"';
+        for( size_t i = 0; i < size; ++i ) {
+            auto c = static_cast<unsigned char>(data[i]);
+            m_out += digits[c >> 4];
+            m_out += digits[c & 0x0f];
+        }
+        m_out += '"';
+    }
+
+} // namespace
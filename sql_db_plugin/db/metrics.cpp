@@ -0,0 +1,133 @@
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+#include <algorithm>
+
+#include <fc/log/logger.hpp>
+#include <fc/io/json.hpp>
+
+namespace eosio {
+
+    uint32_t latency_histogram::bucket_index( uint64_t value ) {
+        if( value < 2 * sub_bucket_count ) return uint32_t(value);
+        uint32_t msb = 63 - __builtin_clzll(value);
+        uint32_t shift = msb - sub_bucket_bits;
+        uint32_t index = (shift + 1) * sub_bucket_count + uint32_t((value >> shift) & (sub_bucket_count - 1));
+        return std::min(index, bucket_count - 1);
+    }
+
+    uint64_t latency_histogram::bucket_value( uint32_t index ) {
+        if( index < 2 * sub_bucket_count ) return index;
+        uint32_t shift = index / sub_bucket_count - 1;
+        uint64_t lower = uint64_t(sub_bucket_count + index % sub_bucket_count) << shift;
+        // midpoint of the bucket
+        return lower + ((uint64_t(1) << shift) >> 1);
+    }
+
+    void latency_histogram::record( uint64_t micros ) {
+        m_buckets[bucket_index(micros)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(micros, std::memory_order_relaxed);
+
+        uint64_t current = m_min.load(std::memory_order_relaxed);
+        while( micros < current && !m_min.compare_exchange_weak(current, micros, std::memory_order_relaxed) ) {}
+        current = m_max.load(std::memory_order_relaxed);
+        while( micros > current && !m_max.compare_exchange_weak(current, micros, std::memory_order_relaxed) ) {}
+    }
+
+    uint64_t latency_histogram::percentile( double quantile ) const {
+        uint64_t total = count();
+        if( total == 0 ) return 0;
+        uint64_t target = std::max<uint64_t>(1, uint64_t(quantile * total + 0.5));
+        uint64_t seen = 0;
+        for( uint32_t i = 0; i < bucket_count; ++i ) {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if( seen >= target ) return std::min( bucket_value(i), m_max.load(std::memory_order_relaxed) );
+        }
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    fc::variant_object latency_histogram::report() const {
+        uint64_t total = count();
+        return fc::mutable_variant_object()
+            ("count", total)
+            ("mean_us", total ? m_sum.load(std::memory_order_relaxed) / total : 0)
+            ("min_us", total ? m_min.load(std::memory_order_relaxed) : 0)
+            ("p50_us", percentile(0.50))
+            ("p90_us", percentile(0.90))
+            ("p99_us", percentile(0.99))
+            ("p999_us", percentile(0.999))
+            ("max_us", m_max.load(std::memory_order_relaxed));
+    }
+
+    metrics& metrics::instance() {
+        static metrics m;
+        return m;
+    }
+
+    latency_histogram& metrics::histogram( const std::string& stage ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& h = m_histograms[stage];
+        if( !h ) h = std::make_unique<latency_histogram>();
+        return *h;
+    }
+
+    std::atomic<uint64_t>& metrics::counter( const std::string& name ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& c = m_counters[name];
+        if( !c ) c = std::make_unique<std::atomic<uint64_t>>(0);
+        return *c;
+    }
+
+    std::atomic<int64_t>& metrics::gauge( const std::string& name ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& g = m_gauges[name];
+        if( !g ) g = std::make_unique<std::atomic<int64_t>>(0);
+        return *g;
+    }
+
+    fc::variant_object metrics::report() {
+        boost::mutex::scoped_lock lock(m_mtx);
+        const auto now = fc::time_point::now();
+        const double uptime = std::max<double>(1, (now - m_started).count() / 1000000.0);
+
+        fc::mutable_variant_object latencies;
+        for( const auto& h : m_histograms ) latencies(h.first, h.second->report());
+
+        fc::mutable_variant_object counters;
+        for( const auto& c : m_counters ) {
+            uint64_t value = c.second->load(std::memory_order_relaxed);
+            counters(c.first, fc::mutable_variant_object()
+                ("total", value)
+                ("per_sec", m_rates[c.first].rate)
+                ("per_sec_avg", value / uptime));
+        }
+
+        fc::mutable_variant_object gauges;
+        for( const auto& g : m_gauges ) gauges(g.first, g.second->load(std::memory_order_relaxed));
+
+        return fc::mutable_variant_object()
+            ("uptime_sec", uint64_t(uptime))
+            ("gauges", gauges)
+            ("latency", latencies)
+            ("throughput", counters);
+    }
+
+    void metrics::maybe_log( fc::microseconds interval ) {
+        if( interval.count() <= 0 ) return;
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            const auto now = fc::time_point::now();
+            if( now - m_last_log < interval ) return;
+            const double elapsed = (now - m_last_log).count() / 1000000.0;
+            m_last_log = now;
+            for( const auto& c : m_counters ) {
+                auto& window = m_rates[c.first];
+                uint64_t value = c.second->load(std::memory_order_relaxed);
+                window.rate = (value - window.last_value) / elapsed;
+                window.last_value = value;
+            }
+        }
+        ilog( "sql_db stats: ${s}", ("s", fc::json::to_string(report())) );
+    }
+
+} // namespace
@@ -0,0 +1,123 @@
+#include <eosio/sql_db_plugin/partition_manager.hpp>
+
+#include <limits>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    namespace {
+        // plain decimal digits only, anything else is not a bound this manager wrote
+        bool parse_bound( const std::string& text, uint32_t& bound ) {
+            if( text.empty() || text.size() > 10 ) return false;
+            uint64_t value = 0;
+            for( char c : text ) {
+                if( c < '0' || c > '9' ) return false;
+                value = value * 10 + uint64_t(c - '0');
+            }
+            if( value == 0 || value > std::numeric_limits<uint32_t>::max() ) return false;
+            bound = uint32_t(value);
+            return true;
+        }
+
+        // every name and bound in an ALTER is rendered from an integer, never from what the server returned
+        std::string partition_name( uint64_t bound ) {
+            return "p" + std::to_string(bound);
+        }
+    }
+
+    const std::vector<std::string> partition_manager::tables = { "actions", "actions_accounts", "transactions" };
+
+    partition_manager::partition_manager( std::shared_ptr<sql_session> session, uint32_t blocks_per_partition, uint32_t ahead, uint32_t retain ):
+        m_session(session), m_blocks_per_partition(blocks_per_partition), m_ahead(ahead), m_retain(retain) {
+    }
+
+    bool partition_manager::partitions( const std::string& table, std::vector<partition>& result ) {
+        result.clear();
+        soci::rowset<soci::row> rs = m_session->rowset<soci::row>(
+            "SELECT PARTITION_NAME, PARTITION_DESCRIPTION FROM information_schema.PARTITIONS "
+            "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = :t ORDER BY PARTITION_ORDINAL_POSITION",
+            soci::use(table) );
+        for( const auto& r : rs ) {
+            // an unpartitioned table has one row with a NULL name
+            if( r.get_indicator(0) != soci::i_ok ) continue;
+            const auto name = r.get<std::string>(0);
+            const auto description = r.get<std::string>(1);
+            partition p;
+            if( description == "MAXVALUE" ) {
+                if( name != "pmax" ) return false;
+            } else if( !parse_bound( description, p.bound ) || name != partition_name(p.bound) ) {
+                return false;
+            }
+            result.push_back(p);
+        }
+        return true;
+    }
+
+    void partition_manager::maintain( uint32_t block_num ) {
+        if( m_blocks_per_partition == 0 || block_num < m_next_check ) return;
+        for( const auto& table : tables ) {
+            if( m_unpartitioned.count(table) ) continue;
+            try {
+                maintain_table( table, block_num );
+            } catch( std::exception& e ) {
+                wlog( "partition maintenance of ${t} failed: ${e}", ("t", table)("e", e.what()) );
+            }
+        }
+        m_next_check = (block_num / m_blocks_per_partition + 1) * m_blocks_per_partition;
+    }
+
+    void partition_manager::maintain_table( const std::string& table, uint32_t block_num ) {
+        std::vector<partition> existing;
+        if( !partitions( table, existing ) ) {
+            wlog( "${t} has partitions not named p<bound> and pmax, partition maintenance skipped", ("t", table) );
+            m_unpartitioned.insert(table);
+            return;
+        }
+        if( existing.empty() ) {
+            wlog( "${t} is not partitioned by block_num, partition maintenance skipped", ("t", table) );
+            m_unpartitioned.insert(table);
+            return;
+        }
+
+        bool has_max = false;
+        uint32_t highest = 0;
+        for( const auto& p : existing ) {
+            if( p.bound == 0 ) has_max = true;
+            else highest = std::max( highest, p.bound );
+        }
+
+        // the partition holding block_num plus `ahead` more above it
+        const uint64_t current = block_num / m_blocks_per_partition;
+        const uint64_t wanted = (current + 1 + m_ahead) * m_blocks_per_partition;
+        std::string added;
+        for( uint64_t bound = uint64_t(highest) + m_blocks_per_partition; bound <= wanted; bound += m_blocks_per_partition ) {
+            if( !added.empty() ) added += ", ";
+            added += "PARTITION " + partition_name(bound) + " VALUES LESS THAN (" + std::to_string(bound) + ")";
+        }
+        if( !added.empty() ) {
+            ilog( "adding partitions to ${t} up to block ${b}", ("t", table)("b", wanted) );
+            if( has_max ) {
+                // pmax is empty while the partitions stay ahead, so reorganizing it moves no rows
+                m_session->execute( "ALTER TABLE `" + table + "` REORGANIZE PARTITION pmax INTO (" + added + ", PARTITION pmax VALUES LESS THAN MAXVALUE)" );
+            } else {
+                m_session->execute( "ALTER TABLE `" + table + "` ADD PARTITION (" + added + ")" );
+            }
+        }
+
+        if( m_retain == 0 || current + 1 <= m_retain ) return;
+        // keep the partition holding block_num and the retain - 1 below it
+        const uint64_t oldest_kept = (current + 1 - m_retain) * m_blocks_per_partition;
+        std::string dropped;
+        for( const auto& p : existing ) {
+            if( p.bound == 0 || p.bound > oldest_kept ) continue;
+            if( !dropped.empty() ) dropped += ",";
+            dropped += partition_name(p.bound);
+        }
+        if( !dropped.empty() ) {
+            ilog( "dropping partitions ${p} of ${t}", ("p", dropped)("t", table) );
+            m_session->execute( "ALTER TABLE `" + table + "` DROP PARTITION " + dropped );
+        }
+    }
+
+} // namespace
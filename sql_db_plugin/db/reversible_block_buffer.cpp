@@ -0,0 +1,57 @@
+#include <eosio/sql_db_plugin/reversible_block_buffer.hpp>
+
+#include <algorithm>
+#include <deque>
+
+namespace eosio {
+
+    std::vector<reversible_block> reversible_block_buffer::add( const chain::block_state_ptr& bs ) {
+        std::vector<reversible_block> dropped;
+        boost::mutex::scoped_lock lock(m_mtx);
+
+        auto& by_num = m_index.get<by_block_num>();
+        auto& by_prev = m_index.get<by_previous>();
+
+        // every block at this height is a sibling of the new head; walk their descendants by previous id
+        std::deque<chain::block_id_type> roots;
+        for( auto itr = by_num.lower_bound(bs->block_num); itr != by_num.end() && itr->block_num == bs->block_num; ++itr ) {
+            if( itr->id != bs->id ) roots.push_back(itr->id);
+        }
+
+        while( !roots.empty() ) {
+            auto id = roots.front();
+            roots.pop_front();
+            auto itr = m_index.find(id);
+            if( itr == m_index.end() ) continue;
+            for( auto child = by_prev.lower_bound(id); child != by_prev.end() && child->previous == id; ++child ) {
+                roots.push_back(child->id);
+            }
+            dropped.emplace_back(*itr);
+            m_index.erase(itr);
+        }
+
+        if( m_index.find(bs->id) == m_index.end() ) {
+            reversible_block rb{ bs->id, bs->header.previous, bs->block_num, bs };
+            rb.trx_ids.reserve( bs->trxs.size() );
+            for( const auto& tm : bs->trxs ) rb.trx_ids.emplace_back( tm->id );
+            m_index.insert( std::move(rb) );
+        }
+
+        std::sort( dropped.begin(), dropped.end(), []( const reversible_block& a, const reversible_block& b ) {
+            return a.block_num < b.block_num;
+        });
+        return dropped;
+    }
+
+    void reversible_block_buffer::prune( uint32_t irreversible_block_num ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        auto& by_num = m_index.get<by_block_num>();
+        by_num.erase( by_num.begin(), by_num.upper_bound(irreversible_block_num) );
+    }
+
+    size_t reversible_block_buffer::size() const {
+        boost::mutex::scoped_lock lock(m_mtx);
+        return m_index.size();
+    }
+
+} // namespace
@@ -0,0 +1,125 @@
+#include <eosio/sql_db_plugin/rollups_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    namespace {
+        std::string from_unixtime( int64_t time ) {
+            return "FROM_UNIXTIME(" + std::to_string(time) + ")";
+        }
+    }
+
+    rollups_table::rollups_table( std::shared_ptr<sql_session> session ):
+        m_session(session) {
+
+    }
+
+    void rollups_table::drop() {
+        try {
+            m_session->execute( "DROP TABLE IF EXISTS hourly_producers" );
+            m_session->execute( "DROP TABLE IF EXISTS hourly_contracts" );
+            m_session->execute( "DROP TABLE IF EXISTS hourly_transfers" );
+        }
+        catch(std::exception& e){
+            wlog(e.what());
+        }
+    }
+
+    void rollups_table::create() {
+        m_session->execute( "CREATE TABLE `hourly_producers` ("
+                "`producer` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`hour` datetime NOT NULL,"
+                "`blocks` bigint(20) unsigned NOT NULL DEFAULT '0',"
+                "`transactions` bigint(20) unsigned NOT NULL DEFAULT '0',"
+                "PRIMARY KEY (`producer`,`hour`),"
+                "KEY `idx_hourly_producers_hour` (`hour`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+
+        m_session->execute( "CREATE TABLE `hourly_contracts` ("
+                "`contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`hour` datetime NOT NULL,"
+                "`actions` bigint(20) unsigned NOT NULL DEFAULT '0',"
+                "PRIMARY KEY (`contract`,`hour`),"
+                "KEY `idx_hourly_contracts_hour` (`hour`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+
+        m_session->execute( "CREATE TABLE `hourly_transfers` ("
+                "`contract` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`symbol` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',"
+                "`hour` datetime NOT NULL,"
+                "`transfers` bigint(20) unsigned NOT NULL DEFAULT '0',"
+                "`volume` decimal(38,0) NOT NULL DEFAULT '0',"
+                "PRIMARY KEY (`contract`,`symbol`,`symbol_precision`,`hour`),"
+                "KEY `idx_hourly_transfers_hour` (`hour`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+    }
+
+    void rollups_table::add_block( const chain::account_name& producer, chain::block_timestamp_type time, uint32_t transactions ) {
+        const int64_t sec = time.operator fc::time_point().sec_since_epoch();
+        auto& counts = m_producers[{ producer.value, hour_of(sec) }];
+        ++counts.blocks;
+        counts.transactions += transactions;
+    }
+
+    void rollups_table::add_action( const chain::account_name& contract, int64_t time ) {
+        ++m_contracts[{ contract.value, hour_of(time) }];
+    }
+
+    void rollups_table::add_transfer( const chain::account_name& contract, const chain::asset& quantity, int64_t time ) {
+        if( quantity.get_amount() <= 0 ) return;
+        auto& counts = m_transfers[ std::make_tuple( contract.value, quantity.get_symbol().value(), hour_of(time) ) ];
+        ++counts.transfers;
+        counts.volume += uint64_t( quantity.get_amount() );
+    }
+
+    void rollups_table::flush() {
+        if( m_producers.empty() && m_contracts.empty() && m_transfers.empty() ) return;
+
+        static auto& sql_latency = metrics::instance().histogram("sql.rollups");
+        static auto& rows = metrics::instance().counter("rows.rollups");
+        scoped_latency timer(sql_latency);
+        rows += m_producers.size() + m_contracts.size() + m_transfers.size();
+
+        for( const auto& p : m_producers ) {
+            m_producer_rows.row()
+                .add( chain::name(p.first.first).to_string() )
+                .add_expr( from_unixtime(p.first.second) )
+                .add( p.second.blocks )
+                .add( p.second.transactions );
+        }
+        for( const auto& c : m_contracts ) {
+            m_contract_rows.row()
+                .add( chain::name(c.first.first).to_string() )
+                .add_expr( from_unixtime(c.first.second) )
+                .add( c.second );
+        }
+        for( const auto& t : m_transfers ) {
+            const chain::symbol sym( std::get<1>(t.first) );
+            m_transfer_rows.row()
+                .add( chain::name(std::get<0>(t.first)).to_string() )
+                .add( sym.name() )
+                .add( sym.decimals() )
+                .add_expr( from_unixtime(std::get<2>(t.first)) )
+                .add( t.second.transfers )
+                .add( t.second.volume );
+        }
+
+        m_producer_rows.flush(*m_session);
+        m_contract_rows.flush(*m_session);
+        m_transfer_rows.flush(*m_session);
+        discard();
+    }
+
+    void rollups_table::discard() {
+        m_producers.clear();
+        m_contracts.clear();
+        m_transfers.clear();
+        m_producer_rows.clear();
+        m_contract_rows.clear();
+        m_transfer_rows.clear();
+    }
+
+} // namespace
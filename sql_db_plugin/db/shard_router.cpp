@@ -0,0 +1,67 @@
+#include <eosio/sql_db_plugin/shard_router.hpp>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    shard_router::shard_router( std::shared_ptr<sql_session> primary ) {
+        m_shards.emplace_back( shard{ primary, nullptr, 0 } );
+    }
+
+    void shard_router::add_shard( std::shared_ptr<sql_session> session ) {
+        shard s{ session, std::make_unique<sync_state_table>(session), 0 };
+        s.watermark = s.sync_state->get();
+        ilog( "shard ${n} at block ${b}", ("n", m_shards.size())("b", s.watermark) );
+        m_shards.emplace_back( std::move(s) );
+    }
+
+    size_t shard_router::shard_of( const chain::account_name& account ) const {
+        if( m_shards.size() == 1 ) return 0;
+        // FNV-1a over the name's 64-bit value: fixed across builds and platforms, unlike std::hash
+        uint64_t hash = 14695981039346656037ull;
+        uint64_t value = account.value;
+        for( int i = 0; i < 8; ++i ) {
+            hash ^= value & 0xff;
+            hash *= 1099511628211ull;
+            value >>= 8;
+        }
+        return hash % m_shards.size();
+    }
+
+    uint32_t shard_router::watermark( uint32_t primary_checkpoint ) const {
+        uint32_t result = primary_checkpoint;
+        for( size_t i = 1; i < m_shards.size(); ++i ) {
+            if( m_shards[i].watermark > 0 ) result = std::min( result, m_shards[i].watermark );
+        }
+        return result;
+    }
+
+    uint64_t shard_router::failures() const {
+        uint64_t result = 0;
+        for( const auto& s : m_shards ) result += s.session->failures();
+        return result;
+    }
+
+    shard_router::transaction::transaction( shard_router& router ):
+        m_router(router) {
+        for( size_t i = 1; i < router.m_shards.size(); ++i ) {
+            m_transactions.emplace_back( std::make_unique<soci::transaction>( *router.m_shards[i].session ) );
+        }
+    }
+
+    void shard_router::transaction::commit( uint32_t block_num, const std::string& block_id ) {
+        for( size_t i = 1; i < m_router.m_shards.size(); ++i ) {
+            auto& s = m_router.m_shards[i];
+            auto& tr = *m_transactions[i - 1];
+            if( s.watermark >= block_num ) {
+                wlog( "shard ${n} already has block ${b}, discarding the redo", ("n", i)("b", block_num) );
+                tr.rollback();
+                continue;
+            }
+            s.sync_state->set( block_num, block_id );
+            tr.commit();
+            s.watermark = block_num;
+        }
+    }
+
+} // namespace
@@ -0,0 +1,204 @@
+#include <eosio/sql_db_plugin/sql_session.hpp>
+
+#include <algorithm>
+#include <cctype>
+
+#include <fc/log/logger.hpp>
+#include <fc/variant_object.hpp>
+
+namespace eosio {
+
+    statement_stats& statement_stats::instance() {
+        static statement_stats s;
+        return s;
+    }
+
+    void statement_stats::configure( fc::microseconds slow_threshold, uint32_t top_n ) {
+        boost::mutex::scoped_lock lock(m_mtx);
+        m_slow_threshold = slow_threshold;
+        m_top_n = top_n;
+    }
+
+    namespace {
+        bool is_word( char c ) {
+            return std::isalnum( static_cast<unsigned char>(c) ) || c == '_' || c == '`' || c == ':';
+        }
+
+        // end of the quoted literal starting at i
+        size_t skip_quoted( const std::string& query, size_t i ) {
+            for( ++i; i < query.size() && query[i] != '\''; ++i ) {
+                if( query[i] == '\\' ) ++i;
+            }
+            return i;
+        }
+
+        // end of the row list of a multi-row `VALUES (...),(...)`, starting at its first '('
+        size_t skip_rows( const std::string& query, size_t i ) {
+            size_t end = i;
+            while( i < query.size() && query[i] == '(' ) {
+                int depth = 0;
+                for( ; i < query.size(); ++i ) {
+                    if( query[i] == '\'' ) i = skip_quoted( query, i );
+                    else if( query[i] == '(' ) ++depth;
+                    else if( query[i] == ')' && --depth == 0 ) break;
+                }
+                end = i;
+                ++i;
+                while( i < query.size() && (query[i] == ',' || query[i] == ' ') ) ++i;
+            }
+            return end;
+        }
+    }
+
+    std::string statement_stats::normalize( const std::string& query ) {
+        std::string result;
+        result.reserve( std::min<size_t>(query.size(), 512) );
+        for( size_t i = 0; i < query.size(); ++i ) {
+            char c = query[i];
+            if( c == 'V' && query.compare( i, 7, "VALUES " ) == 0 && i + 7 < query.size() && query[i+7] == '(' ) {
+                // batched inserts: neither the literals nor the number of rows are part of the template
+                result += "VALUES (?)";
+                i = skip_rows( query, i + 7 );
+            } else if( std::isdigit( static_cast<unsigned char>(c) ) && (result.empty() || !is_word(result.back())) ) {
+                while( i + 1 < query.size() && (std::isalnum( static_cast<unsigned char>(query[i+1]) ) || query[i+1] == '.') ) ++i;
+                result += '?';
+            } else if( c == '\'' ) {
+                // quoted literal, possibly with backslash escapes
+                i = skip_quoted( query, i );
+                result += '?';
+            } else if( (c == 'I' || c == 'i') && i + 3 < query.size() && (query[i+1] == 'N' || query[i+1] == 'n')
+                       && query[i+2] == ' ' && query[i+3] == '(' && (i == 0 || query[i-1] == ' ') ) {
+                // batched deletes: the length of the list is not part of the template
+                auto close = query.find(')', i);
+                if( close == std::string::npos ) close = query.size() - 1;
+                result += "IN (?)";
+                i = close;
+            } else if( c == ' ' && !result.empty() && result.back() == ' ' ) {
+                continue;
+            } else {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    void statement_stats::record( const std::string& query, uint64_t micros, const std::vector<std::string>& params, bool failed ) {
+        auto key = normalize(query);
+        bool slow = false;
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            auto& a = m_templates[key];
+            ++a.count;
+            a.total_us += micros;
+            a.max_us = std::max(a.max_us, micros);
+            if( failed ) ++a.failures;
+            slow = m_slow_threshold.count() > 0 && micros >= uint64_t(m_slow_threshold.count());
+        }
+        if( slow ) {
+            wlog( "slow statement ${ms}ms: ${q} params: ${p}", ("ms", micros / 1000)("q", query.substr(0, 1024))("p", params) );
+        }
+    }
+
+    fc::variants statement_stats::top() {
+        std::vector<std::pair<std::string, aggregate>> sorted;
+        uint32_t top_n;
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            sorted.assign( m_templates.begin(), m_templates.end() );
+            top_n = m_top_n;
+        }
+        auto n = std::min<size_t>( top_n, sorted.size() );
+        std::partial_sort( sorted.begin(), sorted.begin() + n, sorted.end(), []( const auto& a, const auto& b ) {
+            return a.second.total_us > b.second.total_us;
+        });
+
+        fc::variants result;
+        for( size_t i = 0; i < n; ++i ) {
+            const auto& a = sorted[i].second;
+            result.emplace_back( fc::mutable_variant_object()
+                ("statement", sorted[i].first)
+                ("count", a.count)
+                ("failures", a.failures)
+                ("total_ms", a.total_us / 1000)
+                ("mean_us", a.count ? a.total_us / a.count : 0)
+                ("max_us", a.max_us) );
+        }
+        return result;
+    }
+
+    void statement_stats::maybe_log( fc::microseconds interval ) {
+        if( interval.count() <= 0 ) return;
+        {
+            boost::mutex::scoped_lock lock(m_mtx);
+            const auto now = fc::time_point::now();
+            if( m_top_n == 0 || now - m_last_log < interval ) return;
+            m_last_log = now;
+        }
+        ilog( "sql_db top statements: ${t}", ("t", top()) );
+    }
+
+    timed_statement::timed_statement( sql_session& session, const soci::details::prepare_temp_type& prepared, std::string query,
+                                      std::vector<std::string> params ):
+        m_session( session ), m_statement( prepared ), m_query( std::move(query) ), m_params( std::move(params) ) {
+    }
+
+    bool timed_statement::execute( bool with_data_exchange ) {
+        const auto start = fc::time_point::now();
+        bool got_data = false;
+        try {
+            got_data = m_statement.execute( with_data_exchange );
+        } catch( ... ) {
+            m_session.record( m_query, start, m_params, true );
+            throw;
+        }
+        m_session.record( m_query, start, m_params, false );
+        return got_data;
+    }
+
+    bool sql_session::execute_values( const std::string& query, const std::string* values, size_t count ) {
+        soci::details::prepare_temp_type prepared( prepare << query );
+        for( size_t i = 0; i < count; ++i ) (void)( prepared, soci::use( values[i] ) );
+        // values are not described, a batch holds far more of them than a slow statement log line
+        return timed_statement( *this, prepared, query, std::vector<std::string>() ).execute(true);
+    }
+
+    void sql_session::record( const std::string& query, fc::time_point start, const std::vector<std::string>& params, bool failed ) {
+        if( failed ) {
+            // called from the handler of the statement's exception
+            try {
+                throw;
+            } catch( const std::exception& e ) {
+                if( is_transient(e) ) ++m_failures;
+            } catch( ... ) {
+            }
+        }
+        statement_stats::instance().record( query, (fc::time_point::now() - start).count(), params, failed );
+    }
+
+    bool sql_session::is_transient( const std::exception& e ) {
+#if SOCI_VERSION >= 400000
+        if( const auto* se = dynamic_cast<const soci::soci_error*>(&e) ) {
+            if( se->get_error_category() == soci::soci_error::connection_error ) return true;
+        }
+#endif
+        // the MySQL client and server messages, older soci does not categorize errors
+        static const char* const transient[] = {
+            "MySQL server has gone away",
+            "Lost connection to MySQL server",
+            "Can't connect to MySQL server",
+            "Lock wait timeout exceeded",
+            "Deadlock found when trying to get lock"
+        };
+        const std::string what = e.what();
+        for( const auto* message : transient ) {
+            if( what.find(message) != std::string::npos ) return true;
+        }
+        return false;
+    }
+
+    std::string sql_session::describe( const std::string& value ) {
+        if( value.size() <= 128 ) return "'" + value + "'";
+        return "'" + value.substr(0, 128) + "...' (" + std::to_string(value.size()) + " bytes)";
+    }
+
+} // namespace
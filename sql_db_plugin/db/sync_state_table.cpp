@@ -0,0 +1,52 @@
+#include <eosio/sql_db_plugin/sync_state_table.hpp>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    sync_state_table::sync_state_table( std::shared_ptr<sql_session> session ):
+        m_session(session) {
+
+    }
+
+    void sync_state_table::drop() {
+        try {
+            m_session->execute( "DROP TABLE IF EXISTS sync_state" );
+        }
+        catch(std::exception& e){
+            wlog(e.what());
+        }
+    }
+
+    void sync_state_table::create() {
+        m_session->execute( "CREATE TABLE `sync_state` ("
+                "`id` tinyint(4) NOT NULL,"
+                "`block_num` bigint(20) NOT NULL DEFAULT '0',"
+                "`block_id` varchar(64) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
+                "`updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP ON UPDATE CURRENT_TIMESTAMP,"
+                "PRIMARY KEY (`id`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
+    }
+
+    void sync_state_table::set( uint32_t block_num, const std::string& block_id ) {
+        m_session->execute( "INSERT INTO sync_state(id, block_num, block_id) VALUES (1, :bn, :id) "
+                    "ON DUPLICATE KEY UPDATE block_num = :bn, block_id = :id",
+            soci::use(block_num),
+            soci::use(block_id),
+            soci::use(block_num),
+            soci::use(block_id) );
+    }
+
+    uint32_t sync_state_table::get() {
+        long long block_num = 0;
+        soci::indicator ind = soci::i_null;
+        try {
+            m_session->execute( "SELECT block_num FROM sync_state WHERE id = 1", soci::into(block_num, ind) );
+        } catch(std::exception& e) {
+            wlog("read sync_state failed. ${e}",("e",e.what()));
+            return 0;
+        }
+        return ind == soci::i_ok ? static_cast<uint32_t>(block_num) : 0;
+    }
+
+} // namespace
@@ -1,20 +1,38 @@
 #include <eosio/sql_db_plugin/traces_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
+#include <eosio/sql_db_plugin/json_writer.hpp>
 
 #include <chrono>
+#include <fc/io/raw.hpp>
 #include <fc/log/logger.hpp>
 
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
 namespace eosio {
 
-    traces_table::traces_table(std::shared_ptr<soci::session> session):
-        m_session(session) {
+    namespace bio = boost::iostreams;
+
+    namespace {
+        // leading byte of data_bin: fc::raw packed trace, zlib compressed
+        const uint8_t binary_format_zlib = 1;
+        // beyond this the cache starts over, tokens are read back from token_supplies
+        const size_t max_tracked_tokens = 1 << 16;
+    }
+
+    traces_table::traces_table(std::shared_ptr<sql_session> session, std::shared_ptr<shard_router> shards):
+        m_session(session), m_shards(shards), m_abi_history(session) {
 
     }
 
     void traces_table::drop() {
         try {
-            *m_session << "DROP TABLE IF EXISTS traces";
-            *m_session << "DROP TABLE IF EXISTS assets";
-            *m_session << "DROP TABLE IF EXISTS tokens";
+            m_session->execute( "DROP TABLE IF EXISTS traces" );
+            m_session->execute( "DROP TABLE IF EXISTS assets" );
+            m_session->execute( "DROP TABLE IF EXISTS tokens" );
+            m_session->execute( "DROP TABLE IF EXISTS token_supplies" );
+            m_session->execute( "DROP TABLE IF EXISTS token_balances" );
         }
         catch(std::exception& e){
             wlog(e.what());
@@ -22,16 +40,18 @@ namespace eosio {
     }
 
     void traces_table::create() {
-        *m_session << "CREATE TABLE `traces` ("
+        m_session->execute( "CREATE TABLE `traces` ("
                 "`tx_id` bigint(20) NOT NULL AUTO_INCREMENT, "
                 "`id` varchar(64) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                 "`data` json DEFAULT NULL,"
+                "`data_bin` longblob,"
                 "`irreversible` tinyint(1) NOT NULL DEFAULT '0',"
+                "`block_num` bigint(20) NOT NULL DEFAULT '0',"
                 "PRIMARY KEY (`tx_id`),"
                 "UNIQUE INDEX `idx_transactions_id` (`id`)"
-                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
 
-        *m_session << "CREATE TABLE `assets`  ("
+        m_session->execute( "CREATE TABLE `assets`  ("
                 "`symbol_owner` varchar(30) CHARACTER SET utf8mb4 COLLATE utf8mb4_0900_ai_ci NOT NULL,"
                 "`amount` double(64, 30) NULL DEFAULT NULL,"
                 "`max_amount` double(64, 30) NULL DEFAULT NULL,"
@@ -40,9 +60,9 @@ namespace eosio {
                 "`issuer` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_0900_ai_ci NULL DEFAULT NULL,"
                 "`owner` varchar(16) CHARACTER SET utf8mb4 COLLATE utf8mb4_0900_ai_ci NULL DEFAULT NULL,"
                 "PRIMARY KEY (`symbol_owner`) USING BTREE"
-                ") ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_0900_ai_ci ROW_FORMAT = Dynamic;";
+                ") ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_0900_ai_ci ROW_FORMAT = Dynamic;" );
 
-        *m_session << "CREATE TABLE `tokens`  ("
+        m_session->execute( "CREATE TABLE `tokens`  ("
                 "`id` bigint(20) NOT NULL AUTO_INCREMENT,"
                 "`account` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
                 "`symbol` varchar(16) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
@@ -52,31 +72,107 @@ namespace eosio {
                 "PRIMARY KEY (`id`) USING BTREE,"
                 "INDEX `idx_tokens_account`(`account`) USING BTREE,"
                 "UNIQUE INDEX `idx_tokens_symbolowneraccount`(`symbol_owner_account`) USING BTREE"
-                ") ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_general_ci;";
+                ") ENGINE = InnoDB CHARACTER SET = utf8mb4 COLLATE = utf8mb4_general_ci;" );
+
+        // token_schema::compact: names and symbol codes as their 64 bit values, amounts in the smallest unit
+        m_session->execute( "CREATE TABLE `token_supplies` ("
+                "`contract` bigint(20) unsigned NOT NULL,"
+                "`symbol_code` bigint(20) unsigned NOT NULL,"
+                "`symbol_precision` tinyint(3) unsigned NOT NULL DEFAULT '0',"
+                "`supply` bigint(20) NOT NULL DEFAULT '0',"
+                "`max_supply` bigint(20) NOT NULL DEFAULT '0',"
+                "`issuer` bigint(20) unsigned NOT NULL DEFAULT '0',"
+                "PRIMARY KEY (`contract`,`symbol_code`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
+
+        m_session->execute( "CREATE TABLE `token_balances` ("
+                "`contract` bigint(20) unsigned NOT NULL,"
+                "`symbol_code` bigint(20) unsigned NOT NULL,"
+                "`account` bigint(20) unsigned NOT NULL,"
+                "`amount` bigint(20) NOT NULL DEFAULT '0',"
+                "PRIMARY KEY (`contract`,`symbol_code`,`account`),"
+                "KEY `idx_token_balances_account` (`account`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;" );
 
     }
 
     void traces_table::add( const chain::transaction_trace_ptr& trace) {
+        add( trace, encode_staged(*trace) );
+    }
+
+    const std::string& traces_table::encode_staged( const chain::transaction_trace& trace ) const {
+        static auto& json_latency = metrics::instance().histogram("json_serialize.traces");
+        static auto& binary_latency = metrics::instance().histogram("binary_serialize.traces");
+
+        const bool binary = m_encoding == trace_encoding::binary;
+        scoped_latency timer(binary ? binary_latency : json_latency);
+        return binary ? encode_binary(trace) : encode(trace);
+    }
+
+    void traces_table::add( const chain::transaction_trace_ptr& trace, const std::string& data ) {
+        static auto& sql_latency = metrics::instance().histogram("sql.traces");
+        static auto& rows = metrics::instance().counter("rows.traces");
+        static auto& bytes = metrics::instance().counter("bytes.traces");
+
         const auto trace_id_str = trace->id.str();
-        const auto data = fc::json::to_string(trace);
+        const bool binary = m_encoding == trace_encoding::binary;
+        scoped_latency timer(sql_latency);
+        ++rows;
+        bytes += data.size();
         try{
-            *m_session << "REPLACE INTO traces(id, data) "
-                        "VALUES (:id, :data)",
-                soci::use(trace_id_str),
-                soci::use(data);
+            if( binary ) {
+                m_session->execute( "REPLACE INTO traces(id, data_bin, block_num) "
+                            "VALUES (:id, :data, :bn)",
+                    soci::use(trace_id_str),
+                    soci::use(data),
+                    soci::use(trace->block_num) );
+            } else {
+                m_session->execute( "REPLACE INTO traces(id, data, block_num) "
+                            "VALUES (:id, :data, :bn)",
+                    soci::use(trace_id_str),
+                    soci::use(data),
+                    soci::use(trace->block_num) );
+            }
                 
         } catch (std::exception e) {
-            wlog( "${e} ${id} ${data}",("e",e.what())("id",trace_id_str)("data",data) );
+            wlog( "${e} ${id} ${size} bytes",("e",e.what())("id",trace_id_str)("size",data.size()) );
         }catch(...){
             wlog("insert trace failed. ${id}",("id",trace_id_str));
         }
     }
 
-    bool traces_table::list( std::string trace_id_str, chain::block_timestamp_type block_time){
-        std::string data;
+    bool traces_table::staged( const std::string& trace_id_str ) {
+        int amount = 0;
+        m_session->execute( "SELECT COUNT(*) FROM traces WHERE id = :id", soci::into(amount), soci::use(trace_id_str) );
+        return amount > 0;
+    }
+
+    void traces_table::remove( uint32_t block_num, const std::vector<std::string>& trace_ids ) {
+        if( trace_ids.empty() ) return;
+        std::string trace_id;
+        auto st = m_session->prepare_timed( "DELETE FROM traces WHERE id = :id AND block_num = :bn",
+                                            soci::use(trace_id), soci::use(block_num) );
+        for( const auto& id : trace_ids ) {
+            trace_id = id;
+            st.execute(true);
+        }
+    }
+
+    bool traces_table::list( const std::string& trace_id_str, uint32_t block_num, chain::block_timestamp_type block_time, fc::microseconds* elapsed,
+                             const flattened_action_visitor& visit ){
+        static auto& apply_latency = metrics::instance().histogram("sql.traces_apply");
+        scoped_latency timer(apply_latency);
+
+        auto& data = m_trace_data;
+        auto& data_bin = m_trace_data_bin;
+        data.clear();
+        data_bin.clear();
+        soci::indicator data_ind = soci::i_null, data_bin_ind = soci::i_null;
         block_timestamp = std::chrono::seconds{block_time.operator fc::time_point().sec_since_epoch()}.count();
         try{
-            *m_session << "SELECT data FROM traces WHERE id = :id",soci::into(data),soci::use(trace_id_str);
+            // either column may hold the trace, depending on the encoding it was staged with
+            m_session->execute( "SELECT data, data_bin FROM traces WHERE id = :id",
+                soci::into(data, data_ind), soci::into(data_bin, data_bin_ind), soci::use(trace_id_str) );
         } catch(std::exception e) {
             wlog( "data:${data}",("data",data) );
             wlog("${e}",("e",e.what()));
@@ -84,16 +180,33 @@ namespace eosio {
             wlog( "data:${data}",("data",data) );
         }
 
-        if(data.empty()){
+        if( data_ind == soci::i_null ) data.clear();
+        if( data_bin_ind == soci::i_null ) data_bin.clear();
+        if(data.empty() && data_bin.empty()){
             wlog( "trace data is null. ${id}",("id",trace_id_str) );
             return false;
         }
-        auto trace = fc::json::from_string(data).as<chain::transaction_trace>();
+        auto trace = data_bin.empty() ? decode(data) : decode_binary(data_bin);
         // ilog("${result}",("result",trace));
-        dfs_inline_traces( trace.action_traces );
+        for_each_flattened_action( trace.action_traces, [&]( const flattened_action& action ) {
+            if( visit ) visit( action );
+            if( m_rollups ) m_rollups->add_action( action.trace.act.account, block_timestamp );
+            // an action its ABI cannot decode never will, retrying the block does not help; its row is
+            // still written, with "{}" data as actions_table::add_data does
+            try {
+                parse_actions( action.trace.act, block_num );
+            } catch( fc::exception& e ) {
+                wlog( "unable to decode ${s}::${n} in block ${b}: ${e}",
+                      ("s", action.trace.act.account)("n", action.trace.act.name)("b", block_num)("e", e.to_string()) );
+            } catch( std::exception& e ) {
+                wlog( "unable to decode ${s}::${n} in block ${b}: ${e}",
+                      ("s", action.trace.act.account)("n", action.trace.act.name)("b", block_num)("e", e.what()) );
+            }
+        });
+        if( elapsed ) *elapsed = trace.elapsed;
 
         try{
-            *m_session << "DELETE FROM traces WHERE id = :id",soci::use(trace_id_str);
+            m_session->execute( "DELETE FROM traces WHERE id = :id",soci::use(trace_id_str) );
         } catch(std::exception e) {
             wlog( "data:${data}",("data",data) );
             wlog("${e}",("e",e.what()));
@@ -104,37 +217,72 @@ namespace eosio {
         return true;
     }
 
-    void traces_table::dfs_inline_traces( vector<chain::action_trace> trace ){
-        for(auto& atc : trace){
-            if( atc.receipt.receiver == atc.act.account ){
-                parse_actions(atc.act);
-                if(atc.inline_traces.size()!=0){
-                    dfs_inline_traces( atc.inline_traces );
-                }
-            }
-        }
+    const std::string& traces_table::encode( const chain::transaction_trace& trace ) {
+        thread_local std::string buffer;
+        buffer.clear();
+        json_writer writer(buffer);
+        writer.write(trace);
+        return buffer;
     }
 
-    void traces_table::parse_actions( chain::action action ) {
-        
-        chain::abi_def abi;
-        std::string abi_def_account;
-        chain::abi_serializer abis;
-        soci::indicator ind;
+    chain::transaction_trace traces_table::decode( const std::string& data ) {
+        return fc::json::from_string(data).as<chain::transaction_trace>();
+    }
 
-        *m_session << "SELECT abi FROM accounts WHERE name = :name", soci::into(abi_def_account, ind), soci::use(action.account.to_string());
+    const std::string& traces_table::encode_binary( const chain::transaction_trace& trace ) {
+        thread_local std::string buffer;
+        thread_local std::vector<char> packed;
+        packed = fc::raw::pack(trace);
+
+        buffer.clear();
+        buffer += char(binary_format_zlib);
+        bio::filtering_ostream out;
+        out.push( bio::zlib_compressor(bio::zlib::best_speed) );
+        out.push( bio::back_inserter(buffer) );
+        bio::write( out, packed.data(), packed.size() );
+        bio::close( out );
+        return buffer;
+    }
 
-        if (!abi_def_account.empty()) {
-            abi = fc::json::from_string(abi_def_account).as<chain::abi_def>();
-        } else if (action.account == chain::config::system_account_name) {
-            abi = chain::eosio_contract_abi(abi);
-        } else {
-            return; // no ABI no party. Should we still store it?
-        }
+    chain::transaction_trace traces_table::decode_binary( const std::string& data ) {
+        FC_ASSERT( !data.empty() && data[0] == char(binary_format_zlib), "unknown staged trace format" );
+
+        std::vector<char> packed;
+        bio::filtering_ostream out;
+        out.push( bio::zlib_decompressor() );
+        out.push( bio::back_inserter(packed) );
+        bio::write( out, data.data() + 1, data.size() - 1 );
+        bio::close( out );
+        return fc::raw::unpack<chain::transaction_trace>(packed);
+    }
 
-        abis.set_abi(abi, max_serialization_time);
+    void traces_table::parse_actions( const chain::action& action, uint32_t block_num ) {
+        
+        // accounts that never set an ABI are known without a query
+        abi_version_ptr abi;
+        if( account_dictionary::instance().has_abi(*m_session, action.account) ) {
+            abi = abi_cache::instance().find(m_abi_history, action.account, block_num);
+        }
+        static const chain::abi_serializer system_abis( chain::eosio_contract_abi(chain::abi_def()), max_serialization_time );
+        const chain::abi_serializer* abis = abi ? &abi->serializer : nullptr;
+        if( !abis && action.account == chain::config::system_account_name ) abis = &system_abis;
+        if( !abis ) return; // no ABI no party. Should we still store it?
+
+        static auto& decode_latency = metrics::instance().histogram("abi_decode.traces");
+        fc::variant abi_data;
+        {
+            scoped_latency timer(decode_latency);
+            abi_data = abis->binary_to_variant(abis->get_action_type(action.name), action.data, max_serialization_time);
+        }
 
-        auto abi_data = abis.binary_to_variant(abis.get_action_type(action.name), action.data, max_serialization_time);
+        // any token contract following eosio.token's transfer signature
+        if( m_rollups && action.name == N(transfer) && abi_data.is_object() && abi_data.get_object().contains("quantity") ) {
+            try {
+                m_rollups->add_transfer( action.account, abi_data["quantity"].as<chain::asset>(), block_timestamp );
+            } catch(...) {
+                // a `quantity` that is not an asset is not a token transfer
+            }
+        }
 
         if( action.account == chain::config::system_account_name ){
 
@@ -145,13 +293,16 @@ namespace eosio {
                 auto producers = fc::json::to_string( abi_data["producers"] );
 
                 try{
-                    *m_session << "INSERT INTO votes ( voter, proxy, producers )  VALUES( :vo, :pro, :pd ) "
+                    if( m_voter_producers ) {
+                        m_voter_producers->vote( chain::name(voter), abi_data["producers"].as<std::vector<chain::account_name>>() );
+                    }
+                    m_shards->session_for(voter).execute( "INSERT INTO votes ( voter, proxy, producers )  VALUES( :vo, :pro, :pd ) "
                             "on  DUPLICATE key UPDATE proxy = :pro, producers =  :pd ",
                             soci::use(voter),
                             soci::use(proxy),
                             soci::use(producers),
                             soci::use(proxy),
-                            soci::use(producers);
+                            soci::use(producers) );
                 } catch(std::exception e) {
                     wlog(" ${voter} ${proxy} ${producers}",("voter",voter)("proxy",proxy)("producers",producers));
                     wlog( "${e}",("e",e.what()) );
@@ -175,30 +326,30 @@ namespace eosio {
                     if( from == receiver ){
                         // ilog("${transfer}",("transfer",transfer));
                         if(!transfer){
-                            *m_session << "UPDATE refunds SET net_amount = ( CASE WHEN net_amount < :na THEN 0 ELSE net_amount - :na END ), "
+                            m_shards->session_for(receiver).execute( "UPDATE refunds SET net_amount = ( CASE WHEN net_amount < :na THEN 0 ELSE net_amount - :na END ), "
                                 "cpu_amount = ( CASE WHEN cpu_amount < :ca THEN 0 ELSE cpu_amount - :ca END) WHERE owner = :ow ",
                                 soci::use(stake_net_quantity.to_real()),
                                 soci::use(stake_net_quantity.to_real()),
                                 soci::use(stake_cpu_quantity.to_real()),
                                 soci::use(stake_cpu_quantity.to_real()),
-                                soci::use(receiver);
+                                soci::use(receiver) );
                         }
 
-                        *m_session << "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other,cpu_amount_for_other )  VALUES( :ac, :nam, :cam, 0, 0 ) "
+                        m_shards->session_for(receiver).execute( "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other,cpu_amount_for_other )  VALUES( :ac, :nam, :cam, 0, 0 ) "
                             "on  DUPLICATE key UPDATE net_amount_for_self = net_amount_for_self +  :nam, cpu_amount_for_self = cpu_amount_for_self + :cam ",
                             soci::use(receiver),
                             soci::use(stake_net_quantity.to_real()),
                             soci::use(stake_cpu_quantity.to_real()),
                             soci::use(stake_net_quantity.to_real()),
-                            soci::use(stake_cpu_quantity.to_real());
+                            soci::use(stake_cpu_quantity.to_real()) );
                     }else{
-                        *m_session << "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, 0, 0, :nam, :cam ) "
+                        m_shards->session_for(receiver).execute( "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, 0, 0, :nam, :cam ) "
                             "on  DUPLICATE key UPDATE net_amount_for_other = net_amount_for_other +  :nam, cpu_amount_for_other = cpu_amount_for_other + :cam ",
                             soci::use(receiver),
                             soci::use(stake_net_quantity.to_real()),
                             soci::use(stake_cpu_quantity.to_real()),
                             soci::use(stake_net_quantity.to_real()),
-                            soci::use(stake_cpu_quantity.to_real());
+                            soci::use(stake_cpu_quantity.to_real()) );
                     }
 
                 } catch(std::exception e) {
@@ -217,25 +368,25 @@ namespace eosio {
                 try{
 
                     if(from == receiver){
-                        *m_session << "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, :nam, :cam, 0, 0 ) "
+                        m_shards->session_for(receiver).execute( "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, :nam, :cam, 0, 0 ) "
                             "on  DUPLICATE key UPDATE net_amount_for_self = net_amount_for_self +  :nam, cpu_amount_for_self = cpu_amount_for_self + :cam ",
                             soci::use(receiver),
                             soci::use(unstake_net_quantity.to_real()),
                             soci::use(unstake_cpu_quantity.to_real()),
                             soci::use(unstake_net_quantity.to_real()),
-                            soci::use(unstake_cpu_quantity.to_real());
+                            soci::use(unstake_cpu_quantity.to_real()) );
                     }else{
-                        *m_session << "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, 0, 0, :nam, :cam ) "
+                        m_shards->session_for(receiver).execute( "INSERT INTO stakes ( account, net_amount_for_self, cpu_amount_for_self, net_amount_for_other, cpu_amount_for_other )  VALUES( :ac, 0, 0, :nam, :cam ) "
                             "on  DUPLICATE key UPDATE net_amount_for_other = net_amount_for_other +  :nam, cpu_amount_for_other = cpu_amount_for_other + :cam ",
                             soci::use(receiver),
                             soci::use(unstake_net_quantity.to_real()),
                             soci::use(unstake_cpu_quantity.to_real()),
                             soci::use(unstake_net_quantity.to_real()),
-                            soci::use(unstake_cpu_quantity.to_real());
+                            soci::use(unstake_cpu_quantity.to_real()) );
                     }
                     // ilog( "blocktime::" );
                     // ilog( "${bt}",("bt",block_timestamp) );
-                    *m_session << "INSERT INTO refunds ( owner, request_time, net_amount, cpu_amount )  VALUES( :ac, FROM_UNIXTIME(:rt), :nam, :cam ) "
+                    m_shards->session_for(from).execute( "INSERT INTO refunds ( owner, request_time, net_amount, cpu_amount )  VALUES( :ac, FROM_UNIXTIME(:rt), :nam, :cam ) "
                             "on  DUPLICATE key UPDATE request_time = FROM_UNIXTIME(:rt), net_amount = net_amount +  :nam, cpu_amount = cpu_amount + :cam ",
                             soci::use(from),
                             soci::use(block_timestamp),
@@ -243,7 +394,7 @@ namespace eosio {
                             soci::use((-unstake_cpu_quantity).to_real()),
                             soci::use(block_timestamp),
                             soci::use((-unstake_net_quantity).to_real()),
-                            soci::use((-unstake_cpu_quantity).to_real());
+                            soci::use((-unstake_cpu_quantity).to_real()) );
 
                 } catch(std::exception e) {
                     wlog("${e}",("e",e.what()));
@@ -255,7 +406,7 @@ namespace eosio {
                 auto owner = abi_data["owner"].as<chain::name>().to_string();
 
                 try{
-                    *m_session << " UPDATE refunds SET net_amount = 0, cpu_amount = 0 WHERE owner = :ow",soci::use(owner);
+                    m_shards->session_for(owner).execute( " UPDATE refunds SET net_amount = 0, cpu_amount = 0 WHERE owner = :ow",soci::use(owner) );
                 } catch(std::exception e) {
                     wlog("${e}",("e",e.what()));
                 } catch(...){
@@ -268,20 +419,24 @@ namespace eosio {
 
             if( action.name == N(create) ){
 
-                auto issuer = abi_data["issuer"].as<chain::name>().to_string();
                 auto maximum_supply = abi_data["maximum_supply"].as<chain::asset>();
+                if( m_token_schema == token_schema::compact ) {
+                    create_token( action.account, abi_data["issuer"].as<chain::account_name>(), maximum_supply );
+                    return;
+                }
+                auto issuer = abi_data["issuer"].as<chain::name>().to_string();
                 auto symbol_owner = (action.account.to_string() + "_" + maximum_supply.symbol_name());
                 string insertassets;
                 try{
                     insertassets = "INSERT assets(symbol_owner, amount, max_amount, symbol_precision, symbol, issuer, owner) VALUES( :so, :am, :mam, :pre, :sym, :issuer, :owner)";
-                    *m_session << insertassets,
+                    m_session->execute( insertassets,
                             soci::use( symbol_owner ),
                             soci::use( 0 ),
                             soci::use( maximum_supply.to_real() ),
                             soci::use( maximum_supply.precision() ),
                             soci::use( maximum_supply.get_symbol().name() ),
                             soci::use( issuer ),
-                            soci::use( action.account.to_string() );
+                            soci::use( action.account.to_string() ) );
                 } catch(std::exception e) {
                     wlog("${e}",("e",e.what()));
                 } catch (...) {
@@ -293,31 +448,35 @@ namespace eosio {
 
                 auto to = abi_data["to"].as<chain::name>().to_string();
                 auto quantity = abi_data["quantity"].as<chain::asset>();
+                if( m_token_schema == token_schema::compact ) {
+                    issue_token( action.account, quantity );
+                    return;
+                }
                 auto symbol_owner = action.account.to_string() + "_" + quantity.get_symbol().name();
                 string symbol_owner_account ;
                 string issuer;
 
                 try{
                     //update asset issue amount
-                    *m_session << "UPDATE assets SET amount = amount + :am WHERE symbol_owner = :so",
+                    m_session->execute( "UPDATE assets SET amount = amount + :am WHERE symbol_owner = :so",
                         soci::use( quantity.to_real() ),
-                        soci::use( symbol_owner );
+                        soci::use( symbol_owner ) );
 
-                    *m_session << "SELECT issuer FROM assets WHERE symbol_owner = :so",
+                    m_session->execute( "SELECT issuer FROM assets WHERE symbol_owner = :so",
                         soci::into( issuer ),
-                        soci::use( symbol_owner );
+                        soci::use( symbol_owner ) );
 
                     symbol_owner_account = action.account.to_string() + "_" + issuer + "_" + quantity.get_symbol().name();
 
                     //add issue's assets and then will have a transfer action to transfer issue's amount to "to".
-                    *m_session << "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
+                    m_shards->session_for(issuer).execute( "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
                             "on  DUPLICATE key UPDATE amount = amount +  :amt ",
                             soci::use( issuer ),
                             soci::use( quantity.get_symbol().name() ),
                             soci::use( quantity.to_real() ),
                             soci::use( symbol_owner ),
                             soci::use( symbol_owner_account ),
-                            soci::use( quantity.to_real() );
+                            soci::use( quantity.to_real() ) );
                 } catch(std::exception e) {
                     wlog("my god : ${e}",("e",e.what()));
                 } catch(...) {
@@ -327,26 +486,30 @@ namespace eosio {
 
             } else if ( action.name == N(transfer) ){
 
+                auto quantity = abi_data["quantity"].as<chain::asset>();
+                if( m_token_schema == token_schema::compact ) {
+                    transfer_token( action.account, abi_data["from"].as<chain::account_name>(), abi_data["to"].as<chain::account_name>(), quantity );
+                    return;
+                }
                 auto from = abi_data["from"].as<chain::name>().to_string();
                 auto to = abi_data["to"].as<chain::name>().to_string();
-                auto quantity = abi_data["quantity"].as<chain::asset>();
                 auto symbol_owner = action.account.to_string() + "_" + quantity.get_symbol().name();
                 auto symbol_owner_account = action.account.to_string() + "_" + to + "_" + quantity.get_symbol().name();
                 auto symbol_owner_from = action.account.to_string() + "_" + from + "_" + quantity.get_symbol().name();
 
                 try{
-                    *m_session << "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
+                    m_shards->session_for(to).execute( "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
                             "on  DUPLICATE key UPDATE amount = amount +  :amt ",
                             soci::use( to ),
                             soci::use( quantity.get_symbol().name() ),
                             soci::use( quantity.to_real() ),
                             soci::use( symbol_owner ),
                             soci::use( symbol_owner_account ),
-                            soci::use( quantity.to_real() );
+                            soci::use( quantity.to_real() ) );
 
-                    *m_session << "UPDATE tokens SET amount = amount - :am WHERE symbol_owner_account = :soac ",
+                    m_shards->session_for(from).execute( "UPDATE tokens SET amount = amount - :am WHERE symbol_owner_account = :soac ",
                             soci::use( quantity.to_real() ),
-                            soci::use( symbol_owner_from );
+                            soci::use( symbol_owner_from ) );
 
                 } catch(std::exception e) {
                     wlog("my god : ${e}",("e",e.what()));
@@ -360,11 +523,13 @@ namespace eosio {
 
           if( action.name == N(create) ){
 
+                chain::account_name issuer_name;
                 string issuer;
                 chain::asset maximum_supply;
 
                 try{ 
-                    issuer = abi_data["issuer"].as<chain::name>().to_string();
+                    issuer_name = abi_data["issuer"].as<chain::account_name>();
+                    issuer = issuer_name.to_string();
                     maximum_supply = abi_data["maximum_supply"].as<chain::asset>();
                 } catch(std::exception e) {
                     wlog( "create args transform variant failed ${account} ${e}",("account",action.account)("e",e.what()) );
@@ -374,18 +539,23 @@ namespace eosio {
                     return ;
                 }
 
+                if( m_token_schema == token_schema::compact ) {
+                    create_token( action.account, issuer_name, maximum_supply );
+                    return;
+                }
+
                 auto symbol_owner = (action.account.to_string() + "_" + maximum_supply.symbol_name());
                 string insertassets;
                 try{
                     insertassets = "INSERT assets(symbol_owner, amount, max_amount, symbol_precision, symbol, issuer, owner) VALUES( :so, :am, :mam, :pre, :sym, :issuer, :owner)";
-                    *m_session << insertassets,
+                    m_session->execute( insertassets,
                             soci::use( symbol_owner ),
                             soci::use( 0 ),
                             soci::use( maximum_supply.to_real() ),
                             soci::use( maximum_supply.precision() ),
                             soci::use( maximum_supply.get_symbol().name() ),
                             soci::use( issuer ),
-                            soci::use( action.account.to_string() );
+                            soci::use( action.account.to_string() ) );
                 } catch (...) {
                     wlog("${sql}",("sql",insertassets) );
                     wlog( "create asset failed. ${issuer} ${maximum_supply}",("issuer",issuer)("maximum_supply",maximum_supply) );
@@ -406,6 +576,11 @@ namespace eosio {
                     wlog( "issue args transform vartient failed ${account}",("account",action.account) );
                     return ;
                 }
+
+                if( m_token_schema == token_schema::compact ) {
+                    issue_token( action.account, quantity );
+                    return;
+                }
                 
                 auto symbol_owner = action.account.to_string() + "_" + quantity.get_symbol().name();
                 string symbol_owner_account ;
@@ -413,25 +588,25 @@ namespace eosio {
 
                 try{
                     //update asset issue amount
-                    *m_session << "UPDATE assets SET amount = amount + :am WHERE symbol_owner = :so",
+                    m_session->execute( "UPDATE assets SET amount = amount + :am WHERE symbol_owner = :so",
                         soci::use( quantity.to_real() ),
-                        soci::use( symbol_owner );
+                        soci::use( symbol_owner ) );
 
-                    *m_session << "SELECT issuer FROM assets WHERE symbol_owner = :so",
+                    m_session->execute( "SELECT issuer FROM assets WHERE symbol_owner = :so",
                         soci::into( issuer ),
-                        soci::use( symbol_owner );
+                        soci::use( symbol_owner ) );
 
                     symbol_owner_account = action.account.to_string() + "_" + issuer + "_" + quantity.get_symbol().name();
 
                     //add issue's assets and then will have a transfer action to transfer issue's amount to "to".
-                    *m_session << "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
+                    m_shards->session_for(issuer).execute( "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
                             "on  DUPLICATE key UPDATE amount = amount +  :amt ",
                             soci::use( issuer ),
                             soci::use( quantity.get_symbol().name() ),
                             soci::use( quantity.to_real() ),
                             soci::use( symbol_owner ),
                             soci::use( symbol_owner_account ),
-                            soci::use( quantity.to_real() );
+                            soci::use( quantity.to_real() ) );
                 } catch(std::exception e) {
                     wlog("my god : ${e}",("e",e.what()));
                 } catch(...) {
@@ -441,13 +616,17 @@ namespace eosio {
 
             } else if ( action.name == N(transfer) ){
 
+                chain::account_name from_name;
+                chain::account_name to_name;
                 string from;
                 string to;
                 chain::asset quantity;
 
                 try{ 
-                    from = abi_data["from"].as<chain::name>().to_string();
-                    to = abi_data["to"].as<chain::name>().to_string();
+                    from_name = abi_data["from"].as<chain::account_name>();
+                    to_name = abi_data["to"].as<chain::account_name>();
+                    from = from_name.to_string();
+                    to = to_name.to_string();
                     quantity = abi_data["quantity"].as<chain::asset>();
                 } catch(std::exception e) {
                     wlog( "transfer args transform variant failed ${account } ${e}",("account",action.account)("e",e.what()) );
@@ -457,23 +636,28 @@ namespace eosio {
                     return ;
                 }
 
+                if( m_token_schema == token_schema::compact ) {
+                    transfer_token( action.account, from_name, to_name, quantity );
+                    return;
+                }
+
                 auto symbol_owner = action.account.to_string() + "_" + quantity.get_symbol().name();
                 auto symbol_owner_account = action.account.to_string() + "_" + to + "_" + quantity.get_symbol().name();
                 auto symbol_owner_from = action.account.to_string() + "_" + from + "_" + quantity.get_symbol().name();
 
                 try{
-                    *m_session << "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
+                    m_shards->session_for(to).execute( "INSERT INTO tokens ( account, symbol, amount, symbol_owner, symbol_owner_account )  VALUES( :ac, :sym, :am, :so, :soac ) "
                             "on  DUPLICATE key UPDATE amount = amount +  :amt ",
                             soci::use( to ),
                             soci::use( quantity.get_symbol().name() ),
                             soci::use( quantity.to_real() ),
                             soci::use( symbol_owner ),
                             soci::use( symbol_owner_account ),
-                            soci::use( quantity.to_real() );
+                            soci::use( quantity.to_real() ) );
 
-                    *m_session << "UPDATE tokens SET amount = amount - :am WHERE symbol_owner_account = :soac ",
+                    m_shards->session_for(from).execute( "UPDATE tokens SET amount = amount - :am WHERE symbol_owner_account = :soac ",
                             soci::use( quantity.to_real() ),
-                            soci::use( symbol_owner_from );
+                            soci::use( symbol_owner_from ) );
 
                 } catch(std::exception e) {
                     wlog("my god : ${e}",("e",e.what()));
@@ -487,4 +671,104 @@ namespace eosio {
         
     }
 
+    void traces_table::create_token( const chain::account_name& contract, const chain::account_name& issuer, const chain::asset& maximum_supply ) {
+        const unsigned long long contract_value = contract.value;
+        const unsigned long long code = maximum_supply.get_symbol().to_symbol_code().value;
+        const unsigned long long issuer_value = issuer.value;
+        const int precision = maximum_supply.decimals();
+        const long long max_supply = maximum_supply.get_amount();
+        try{
+            m_session->execute( "INSERT INTO token_supplies(contract, symbol_code, symbol_precision, max_supply, issuer) "
+                          "VALUES( :c, :s, :p, :m, :i )",
+                    soci::use( contract_value ),
+                    soci::use( code ),
+                    soci::use( precision ),
+                    soci::use( max_supply ),
+                    soci::use( issuer_value ) );
+        } catch(std::exception& e) {
+            wlog( "create token failed. ${c} ${s} ${e}",("c",contract)("s",maximum_supply)("e",e.what()) );
+        }
+    }
+
+    bool traces_table::token_tracked( uint64_t contract, uint64_t code, uint64_t* issuer ) {
+        const auto key = std::make_pair( contract, code );
+        auto itr = m_tracked_tokens.find( key );
+        if( itr != m_tracked_tokens.end() ) {
+            if( issuer ) *issuer = itr->second;
+            return true;
+        }
+
+        const unsigned long long contract_value = contract;
+        const unsigned long long code_value = code;
+        unsigned long long issuer_value = 0;
+        const bool found = m_session->execute( "SELECT issuer FROM token_supplies WHERE contract = :c AND symbol_code = :s",
+                soci::into( issuer_value ),
+                soci::use( contract_value ),
+                soci::use( code_value ) );
+        if( !found ) return false;
+
+        if( m_tracked_tokens.size() >= max_tracked_tokens ) m_tracked_tokens.clear();
+        m_tracked_tokens.emplace( key, issuer_value );
+        if( issuer ) *issuer = issuer_value;
+        return true;
+    }
+
+    void traces_table::issue_token( const chain::account_name& contract, const chain::asset& quantity ) {
+        const unsigned long long contract_value = contract.value;
+        const unsigned long long code = quantity.get_symbol().to_symbol_code().value;
+        const long long amount = quantity.get_amount();
+        uint64_t issuer = 0;
+        try{
+            // created before the plugin's first block: supply and balances are unknown, leave them out
+            if( !token_tracked( contract_value, code, &issuer ) ) return;
+            const unsigned long long issuer_value = issuer;
+
+            m_session->execute( "UPDATE token_supplies SET supply = supply + :am WHERE contract = :c AND symbol_code = :s",
+                    soci::use( amount ),
+                    soci::use( contract_value ),
+                    soci::use( code ) );
+
+            // credited to the issuer, the transfer on to `to` follows as an inline action
+            m_shards->session_for( chain::account_name(issuer) ).execute(
+                    "INSERT INTO token_balances(contract, symbol_code, account, amount) VALUES( :c, :s, :a, :am ) "
+                    "ON DUPLICATE KEY UPDATE amount = amount + VALUES(amount)",
+                    soci::use( contract_value ),
+                    soci::use( code ),
+                    soci::use( issuer_value ),
+                    soci::use( amount ) );
+        } catch(std::exception& e) {
+            wlog( "issue token failed. ${c} ${q} ${e}",("c",contract)("q",quantity)("e",e.what()) );
+        }
+    }
+
+    void traces_table::transfer_token( const chain::account_name& contract, const chain::account_name& from, const chain::account_name& to,
+                                       const chain::asset& quantity ) {
+        const unsigned long long contract_value = contract.value;
+        const unsigned long long code = quantity.get_symbol().to_symbol_code().value;
+        const unsigned long long from_value = from.value;
+        const unsigned long long to_value = to.value;
+        const long long amount = quantity.get_amount();
+        try{
+            // same as issue_token, an untracked token would only hold partial balances
+            if( !token_tracked( contract_value, code ) ) return;
+
+            m_shards->session_for(to).execute(
+                    "INSERT INTO token_balances(contract, symbol_code, account, amount) VALUES( :c, :s, :a, :am ) "
+                    "ON DUPLICATE KEY UPDATE amount = amount + VALUES(amount)",
+                    soci::use( contract_value ),
+                    soci::use( code ),
+                    soci::use( to_value ),
+                    soci::use( amount ) );
+
+            m_shards->session_for(from).execute(
+                    "UPDATE token_balances SET amount = amount - :am WHERE contract = :c AND symbol_code = :s AND account = :a",
+                    soci::use( amount ),
+                    soci::use( contract_value ),
+                    soci::use( code ),
+                    soci::use( from_value ) );
+        } catch(std::exception& e) {
+            wlog( "transfer token failed. ${f} transfer to ${t} ${q} ${e}",("f",from)("t",to)("q",quantity)("e",e.what()) );
+        }
+    }
+
 } // namespace
@@ -1,27 +1,31 @@
 // #include "transactions_table.hpp"
 #include <eosio/sql_db_plugin/transactions_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
 
 #include <chrono>
 #include <fc/log/logger.hpp>
 
 namespace eosio {
 
-    transactions_table::transactions_table(std::shared_ptr<soci::session> session):
+    transactions_table::transactions_table(std::shared_ptr<sql_session> session):
         m_session(session) {
 
     }
 
     void transactions_table::drop() {
         try {
-            *m_session << "DROP TABLE IF EXISTS transactions";
+            m_session->execute( "DROP TABLE IF EXISTS transactions" );
         }
         catch(std::exception& e){
             wlog(e.what());
         }
     }
 
-    void transactions_table::create() {
-        *m_session << "CREATE TABLE `transactions` ("
+    void transactions_table::create( uint32_t blocks_per_partition ) {
+        // every unique key of a partitioned table has to include the partitioning column; a transaction
+        // is only written with its irreversible block, so (id, block_num) still rejects a repeated id
+        const std::string block_key = blocks_per_partition ? ",`block_num`" : "";
+        m_session->execute( "CREATE TABLE `transactions` ("
             "`tx_id` bigint(20) NOT NULL AUTO_INCREMENT,"
             "`id` varchar(64) COLLATE utf8mb4_general_ci NOT NULL DEFAULT '',"
             "`block_id` varchar(64) NOT NULL DEFAULT '0',"
@@ -33,43 +37,64 @@ namespace eosio {
             "`num_actions` bigint(20) DEFAULT '0',"
             "`updated_at` datetime NOT NULL DEFAULT CURRENT_TIMESTAMP,"
             "`irreversible` tinyint(1) NOT NULL DEFAULT '0',"
-            "PRIMARY KEY (`tx_id`),"
-            "UNIQUE INDEX `idx_transactions_id` (`id`),"
-            "KEY `transactions_block_id` (`block_id`)"
-            ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;";
+            "`block_num` bigint(20) NOT NULL DEFAULT '0',"
+            "`status` tinyint(3) unsigned DEFAULT NULL,"
+            "`cpu_usage_us` int(10) unsigned DEFAULT NULL,"
+            "`net_usage_words` int(10) unsigned DEFAULT NULL,"
+            "`elapsed` bigint(20) DEFAULT NULL,"
+            "PRIMARY KEY (`tx_id`" + block_key + "),"
+            "UNIQUE INDEX `idx_transactions_id` (`id`" + block_key + "),"
+            "KEY `transactions_block_id` (`block_id`),"
+            "KEY `idx_transactions_block_num` (`block_num`)"
+            ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci" + partition_by_block(blocks_per_partition) );
 
         // *m_session << "CREATE INDEX transactions_block_id ON transactions (block_id);";
 
     }
 
-    void transactions_table::add( chain::transaction transaction) {
-        const auto transaction_id_str = transaction.id().str();
-        const auto expiration = std::chrono::seconds{transaction.expiration.sec_since_epoch()}.count();
-        try{
-            *m_session << "INSERT INTO transactions(id, ref_block_num, ref_block_prefix, expiration, pending, created_at, updated_at, num_actions) "
-                        "VALUES (:id, :rbi, :rb, FROM_UNIXTIME(:ex), :pe, FROM_UNIXTIME(:ca), FROM_UNIXTIME(:ua), :na)",
-                soci::use(transaction_id_str),
-                soci::use(transaction.ref_block_num),
-                soci::use(transaction.ref_block_prefix),
-                soci::use(expiration),
-                soci::use(0),
-                soci::use(expiration),
-                soci::use(expiration),
-                soci::use(transaction.total_actions());
-        } catch (std::exception e) {
-            wlog("insert transaction failed. ${id}",("id",transaction_id_str));
-            wlog("${e}",("e",e.what()));
-        } catch(...){
-            wlog("insert transaction failed. ${id}",("id",transaction_id_str));
+    void transactions_table::add( const chain::transaction& transaction, const std::string& transaction_id_str, uint32_t block_num,
+                                  const std::string& block_id, bool irreversible, const transaction_usage* usage ) {
+        const auto expiration = "FROM_UNIXTIME(" + std::to_string( std::chrono::seconds{transaction.expiration.sec_since_epoch()}.count() ) + ")";
+
+        m_pending.row()
+            .add(transaction_id_str)
+            .add(transaction.ref_block_num)
+            .add(transaction.ref_block_prefix)
+            .add_expr(expiration)
+            .add(0)
+            .add_expr(expiration)
+            .add_expr(expiration)
+            .add(transaction.total_actions())
+            .add(block_num)
+            .add(block_id.empty() ? std::string("0") : block_id)
+            .add(irreversible ? 1 : 0);
+        if( usage ) {
+            m_pending.add(uint8_t(usage->status))
+                .add(usage->cpu_usage_us)
+                .add(usage->net_usage_words);
+            if( usage->elapsed ) m_pending.add(usage->elapsed->count());
+            else m_pending.add_null();
+        } else {
+            m_pending.add_null().add_null().add_null().add_null();
         }
     }
 
+    void transactions_table::flush() {
+        if( m_pending.empty() ) return;
+
+        static auto& sql_latency = metrics::instance().histogram("sql.transactions");
+        static auto& rows = metrics::instance().counter("rows.transactions");
+        scoped_latency timer(sql_latency);
+        rows += m_pending.size();
+        m_pending.flush(*m_session);
+    }
+
     void transactions_table::irreversible_set( std::string block_id, bool irreversible, std::string transaction_id_str) {
         try{
-            *m_session << "UPDATE transactions SET block_id = :block_id, irreversible = :irreversible WHERE id = :id ",
+            m_session->execute( "UPDATE transactions SET block_id = :block_id, irreversible = :irreversible WHERE id = :id ",
                 soci::use(block_id),
                 soci::use(irreversible?1:0),
-                soci::use(transaction_id_str);
+                soci::use(transaction_id_str) );
         } catch (std::exception e) {
             wlog("update transaction failed ${id}",("id",transaction_id_str));
             wlog("${e}",("e",e.what()));
@@ -78,12 +103,29 @@ namespace eosio {
         }
     }
 
+    void transactions_table::irreversible_set( const std::string& block_id, uint32_t block_num, const std::string& transaction_id_str,
+                                               const transaction_usage& usage ) {
+        try{
+            m_session->execute( "UPDATE transactions SET block_id = :block_id, irreversible = 1, block_num = :bn, "
+                          "status = :st, cpu_usage_us = :cpu, net_usage_words = :net WHERE id = :id ",
+                soci::use(block_id),
+                soci::use(block_num),
+                soci::use(int(usage.status)),
+                soci::use(usage.cpu_usage_us),
+                soci::use(usage.net_usage_words),
+                soci::use(transaction_id_str) );
+        } catch (std::exception& e) {
+            wlog("update transaction failed ${id}",("id",transaction_id_str));
+            wlog("${e}",("e",e.what()));
+        }
+    }
+
     bool transactions_table::find_transaction( std::string transaction_id_str) {
         int amount;
         try{
-            *m_session << "SELECT COUNT(*) FROM transactions WHERE id = :id",
+            m_session->execute( "SELECT COUNT(*) FROM transactions WHERE id = :id",
                 soci::into(amount),
-                soci::use(transaction_id_str);
+                soci::use(transaction_id_str) );
         } catch(...) {
             amount = 0;
             wlog("find transaction failed. ${id}",("id",transaction_id_str));
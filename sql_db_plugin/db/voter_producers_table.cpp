@@ -0,0 +1,120 @@
+#include <eosio/sql_db_plugin/voter_producers_table.hpp>
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+#include <fc/log/logger.hpp>
+
+namespace eosio {
+
+    namespace {
+        // beyond this the cache starts over, voters are read back as they vote again
+        const size_t max_cached_voters = 1 << 20;
+    }
+
+    voter_producers_table::voter_producers_table( std::shared_ptr<shard_router> shards ):
+        m_shards(shards) {
+
+    }
+
+    void voter_producers_table::drop() {
+        try {
+            m_shards->primary().execute( "DROP TABLE IF EXISTS voter_producers" );
+        }
+        catch(std::exception& e){
+            wlog(e.what());
+        }
+    }
+
+    void voter_producers_table::create() {
+        m_shards->primary().execute( "CREATE TABLE `voter_producers` ("
+                "`voter` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "`producer` varchar(16) COLLATE utf8mb4_unicode_ci NOT NULL DEFAULT '',"
+                "PRIMARY KEY (`voter`,`producer`),"
+                "KEY `idx_voter_producers_producer` (`producer`)"
+                ") ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_unicode_ci;" );
+    }
+
+    void voter_producers_table::vote( const chain::account_name& voter, const std::vector<chain::account_name>& producers ) {
+        auto itr = m_pending.find(voter.value);
+        if( itr == m_pending.end() ) {
+            auto cached = m_cache.find(voter.value);
+            pending_vote vote;
+            vote.before = cached != m_cache.end() ? cached->second : load(voter);
+            itr = m_pending.emplace( voter.value, std::move(vote) ).first;
+        }
+
+        auto& after = itr->second.after;
+        after.clear();
+        after.reserve( producers.size() );
+        for( const auto& producer : producers ) after.push_back( producer.value );
+        std::sort( after.begin(), after.end() );
+        after.erase( std::unique( after.begin(), after.end() ), after.end() );
+    }
+
+    voter_producers_table::producer_set voter_producers_table::load( const chain::account_name& voter ) {
+        static auto& loads = metrics::instance().counter("voter_producers.loads");
+        ++loads;
+
+        producer_set producers;
+        const auto voter_str = voter.to_string();
+        soci::rowset<std::string> rs = m_shards->session_for(voter).rowset<std::string>(
+            "SELECT producer FROM voter_producers WHERE voter = :v", soci::use(voter_str) );
+        for( const auto& producer : rs ) producers.push_back( chain::name(producer).value );
+        std::sort( producers.begin(), producers.end() );
+        return producers;
+    }
+
+    voter_producers_table::pending_rows& voter_producers_table::rows_for( size_t shard ) {
+        while( m_rows.size() <= shard ) m_rows.emplace_back( std::make_unique<pending_rows>() );
+        return *m_rows[shard];
+    }
+
+    void voter_producers_table::flush() {
+        if( m_pending.empty() ) return;
+
+        static auto& sql_latency = metrics::instance().histogram("sql.voter_producers");
+        static auto& rows = metrics::instance().counter("rows.voter_producers");
+        scoped_latency timer(sql_latency);
+
+        producer_set changed;
+        for( const auto& p : m_pending ) {
+            const chain::account_name voter(p.first);
+            const auto voter_str = voter.to_string();
+            auto& shard_rows = rows_for( m_shards->shard_of(voter) );
+
+            changed.clear();
+            std::set_difference( p.second.after.begin(), p.second.after.end(), p.second.before.begin(), p.second.before.end(),
+                                 std::back_inserter(changed) );
+            for( auto producer : changed ) shard_rows.inserts.row().add(voter_str).add( chain::name(producer).to_string() );
+            rows += changed.size();
+
+            changed.clear();
+            std::set_difference( p.second.before.begin(), p.second.before.end(), p.second.after.begin(), p.second.after.end(),
+                                 std::back_inserter(changed) );
+            for( auto producer : changed ) shard_rows.deletes.row().add(voter_str).add( chain::name(producer).to_string() );
+            rows += changed.size();
+        }
+
+        for( size_t shard = 0; shard < m_rows.size(); ++shard ) {
+            m_rows[shard]->deletes.flush( m_shards->session(shard) );
+            m_rows[shard]->inserts.flush( m_shards->session(shard) );
+        }
+    }
+
+    void voter_producers_table::committed() {
+        if( m_cache.size() + m_pending.size() > max_cached_voters ) m_cache.clear();
+        for( auto& p : m_pending ) m_cache[p.first] = std::move(p.second.after);
+        m_pending.clear();
+    }
+
+    void voter_producers_table::discard() {
+        m_pending.clear();
+        for( auto& rows : m_rows ) {
+            rows->inserts.clear();
+            rows->deletes.clear();
+        }
+    }
+
+} // namespace
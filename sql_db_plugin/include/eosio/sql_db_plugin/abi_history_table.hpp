@@ -0,0 +1,89 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+#include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/abi_json_writer.hpp>
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/chain/abi_serializer.hpp>
+
+namespace eosio {
+
+/**
+ * One ABI of an account, in effect from block_num until the account's next setabi.
+ * Immutable once built, so the writer and serializer derived from it are shared freely.
+ */
+struct abi_version {
+    abi_version( uint32_t block_num, chain::abi_def abi, const fc::microseconds& max_serialization_time );
+    abi_version( const abi_version& ) = delete;
+
+    const uint32_t block_num;
+    const chain::abi_def abi;
+    const fc::microseconds max_serialization_time;
+    // refers into `abi`
+    const abi_json_writer writer;
+    const chain::abi_serializer serializer;
+};
+
+using abi_version_ptr = std::shared_ptr<const abi_version>;
+
+// every ABI an account has had, keyed by the block of its setabi
+class abi_history_table : public mysql_table {
+    public:
+        abi_history_table(){}
+        abi_history_table(std::shared_ptr<sql_session> session);
+
+        void drop();
+        void create();
+        void add( const chain::account_name& account, uint32_t block_num, const chain::bytes& abi_bin );
+        // oldest first; accounts whose ABI predates the history get their accounts.abi at accounts.abi_block_num
+        std::map<uint32_t, chain::abi_def> load( const chain::account_name& account );
+
+    private:
+        std::shared_ptr<sql_session> m_session;
+};
+
+/**
+ * Interval index over abi_history: the ABI in effect at a block is the version with the
+ * greatest block_num not above it. Accounts are loaded from the table on first use and
+ * kept until the cache outgrows its bound, when it starts over at the next commit; setabi
+ * adds versions as they are written, and they are dropped again by discard() unless
+ * committed() confirms the writer's transaction. setabi only comes from irreversible blocks,
+ * so a version never belongs to a forked-out block. Shared by every writer connection and
+ * the background decoder.
+ */
+class abi_cache {
+    public:
+        static abi_cache& instance();
+
+        // null when the account has no ABI at that block; block_num 0 asks for the latest
+        abi_version_ptr find( abi_history_table& history, const chain::account_name& account, uint32_t block_num );
+        void add( const chain::account_name& account, uint32_t block_num, const chain::abi_def& abi );
+        // after the transaction that wrote the added versions to abi_history committed, or rolled back
+        void committed();
+        void discard();
+
+    private:
+        struct account_versions {
+            bool loaded = false;
+            std::map<uint32_t, abi_version_ptr> versions;
+        };
+
+        abi_version_ptr lookup( const account_versions& account, uint32_t block_num ) const;
+
+        // same budget the writers get from mysql_table
+        const fc::microseconds m_max_serialization_time = fc::microseconds(150*1000);
+        boost::mutex m_mtx;
+        std::map<chain::account_name, account_versions> m_accounts;
+        // versions added since the last committed() or discard()
+        std::vector<std::pair<chain::account_name, uint32_t>> m_uncommitted;
+        // held over all accounts, compared against the bound at each commit
+        size_t m_versions = 0;
+};
+
+} // namespace
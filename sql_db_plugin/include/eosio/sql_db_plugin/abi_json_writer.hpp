@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include <eosio/chain/abi_def.hpp>
+#include <eosio/sql_db_plugin/json_writer.hpp>
+
+namespace eosio {
+
+/**
+ * Decodes ABI-encoded binary straight into JSON, in the shape abi_serializer::binary_to_variant
+ * followed by fc::json::to_string would give, without the intermediate variant tree.
+ *
+ * Covers structs, typedefs, arrays, optionals and the integer, name, string, bytes, checksum,
+ * key, asset and time builtins. Anything else (floats, 128-bit integers, signatures, variants,
+ * binary extensions) makes write() return false so the caller can fall back to abi_serializer.
+ * write() keeps no state in the writer, so one instance can serve several threads.
+ */
+class abi_json_writer {
+    public:
+        // receives the top level fields whose type is a name, e.g. the parties of a transfer
+        using name_field_callback = std::function<void( const std::string& field, const chain::name& value )>;
+
+        abi_json_writer( const chain::abi_def& abi, fc::microseconds max_serialization_time );
+
+        // empty when the ABI has no such action
+        std::string action_type( const chain::action_name& action ) const;
+
+        // appends the JSON of `type` read from `data` to `out`; throws on malformed data
+        bool write( const std::string& type, const std::vector<char>& data, std::string& out, const name_field_callback& on_name = name_field_callback() ) const;
+
+        // cursor over the action data
+        struct reader {
+            const char* pos;
+            const char* end;
+
+            void read( void* dest, size_t size );
+            uint32_t read_varuint32();
+        };
+
+    private:
+        struct unsupported {};
+
+        // per write() call
+        struct context {
+            reader in;
+            fc::time_point deadline;
+            const name_field_callback* on_name;
+        };
+
+        const std::string& resolve( const std::string& type ) const;
+        void write_type( const std::string& type, context& ctx, json_writer& out, uint32_t depth ) const;
+        void write_struct( const chain::struct_def& def, context& ctx, json_writer& out, uint32_t depth, bool& first, bool top_level ) const;
+        // returns false when `type` is not a builtin
+        bool write_builtin( const std::string& type, reader& in, json_writer& out ) const;
+
+        const chain::abi_def& m_abi;
+        std::unordered_map<std::string, std::string> m_typedefs;
+        std::unordered_map<std::string, const chain::struct_def*> m_structs;
+        fc::microseconds m_max_serialization_time;
+};
+
+} // namespace
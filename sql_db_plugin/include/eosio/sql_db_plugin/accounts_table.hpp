@@ -1,15 +1,72 @@
 #pragma once
 
+#include <unordered_map>
+
+#include <boost/thread/mutex.hpp>
+
 #include <eosio/sql_db_plugin/table.hpp>
 
+#include <eosio/chain/types.hpp>
+
+#include <fc/optional.hpp>
+
 namespace eosio {
 
 using std::string;
 
+/**
+ * Every account of the `accounts` table by name value, with its row id and what the writers
+ * check per action, so those checks never query. Loaded once at startup and kept up by
+ * newaccount and setabi. New rows are only added through intern(), so a name gets one row
+ * from now on, although `accounts.name` is not unique; for older duplicates the lowest id
+ * wins. Shared by every writer connection: what a session changes inside a transaction is
+ * pending, seen by that session only, until committed() or discard() for it.
+ */
+class account_dictionary {
+    public:
+        enum flags : uint8_t {
+            has_abi = 1
+        };
+
+        struct entry {
+            uint64_t id = 0;
+            // of the latest setabi, 0 when set before the plugin recorded it
+            uint32_t abi_block_num = 0;
+            uint8_t flags = 0;
+        };
+
+        static account_dictionary& instance();
+
+        // reads `accounts` the first time, later calls return at once; throws when it cannot,
+        // e.g. on a schema without `abi_block_num`, and the next call tries again
+        void load( sql_session& session );
+
+        // as `session` sees the account, its pending changes included
+        bool exists( const sql_session& session, const chain::account_name& account );
+        bool has_abi( const sql_session& session, const chain::account_name& account );
+        fc::optional<entry> find( const sql_session& session, const chain::account_name& account );
+
+        // the account's row id, inserting the row (with `abi` JSON when not empty) if the account is new
+        uint64_t intern( sql_session& session, const chain::account_name& account, const string& abi = string() );
+        void set_abi( const sql_session& session, const chain::account_name& account, uint32_t block_num );
+
+        void committed( const sql_session& session );
+        void discard( const sql_session& session );
+
+    private:
+        const entry* lookup( const sql_session& session, uint64_t account ) const;
+
+        boost::mutex m_mtx;
+        bool m_loaded = false;
+        std::unordered_map<uint64_t, entry> m_accounts;
+        // rows interned and ABIs set by a transaction not yet committed, by the session running it
+        std::unordered_map<const sql_session*, std::unordered_map<uint64_t, entry>> m_pending;
+};
+
 class accounts_table  : public mysql_table {
     public:
         accounts_table(){};
-        accounts_table(std::shared_ptr<soci::session> session);
+        accounts_table(std::shared_ptr<sql_session> session);
 
         void drop();
         void create();
@@ -18,7 +75,7 @@ class accounts_table  : public mysql_table {
         void add_eosio(string name,string abi);
 
     private:
-        std::shared_ptr<soci::session> m_session;
+        std::shared_ptr<sql_session> m_session;
 };
 
 } // namespace
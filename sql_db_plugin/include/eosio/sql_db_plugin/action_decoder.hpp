@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+
+#include <boost/atomic.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <eosio/sql_db_plugin/actions_table.hpp>
+
+namespace eosio {
+
+/**
+ * Fills actions.data for rows written with action_data_encoding::raw, off the ingest path.
+ *
+ * Runs on its own connection and thread, reading the rows still marked `decoded = 0` in
+ * id order, a batch at a time, and decoding data_raw with the ABI in effect at the row's
+ * block, from abi_cache. The flag is cleared with the row's update, so a row committed
+ * late by a writer, with a lower id than rows already done, is still picked up. The raw
+ * bytes stay authoritative either way. With sharding there is one decoder per shard,
+ * all reading ABIs from the primary.
+ */
+class action_decoder {
+    public:
+        action_decoder( const std::string& uri, const std::string& abi_uri, uint32_t batch_size, fc::microseconds idle );
+        ~action_decoder();
+
+        void start();
+        void stop();
+
+    private:
+        struct pending_row {
+            long long id = 0;
+            std::string account;
+            std::string name;
+            std::string data_raw;
+            long long block_num = 0;
+        };
+
+        void run();
+        // rows examined in this batch; 0 once no row is left with decoded = 0
+        size_t decode_batch();
+        void idle( fc::microseconds duration );
+
+        std::shared_ptr<sql_session> m_session;
+        abi_history_table m_abi_history;
+        uint32_t m_batch_size;
+        fc::microseconds m_idle;
+
+        boost::atomic<bool> m_exit{false};
+        boost::mutex m_mtx;
+        boost::condition_variable m_cond;
+        boost::thread m_thread;
+};
+
+} // namespace
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/accounts_table.hpp>
+#include <eosio/sql_db_plugin/abi_history_table.hpp>
+#include <eosio/sql_db_plugin/shard_router.hpp>
+#include <eosio/sql_db_plugin/batched_insert.hpp>
 
+#include <unordered_map>
 
-#include <boost/uuid/uuid.hpp>
-#include <boost/uuid/uuid_io.hpp>
-#include <boost/uuid/uuid_generators.hpp>
 
 #include <eosio/chain/block_state.hpp>
 #include <eosio/chain/eosio_contract.hpp>
@@ -30,23 +32,77 @@ struct system_contract_arg{
     chain::account_name account;
 };
 
+// how actions.data is filled: decoded at insert, or left to action_decoder with the bytes kept in data_raw
+enum class action_data_encoding { json, raw };
+
 class actions_table : public mysql_table {
     public:
         actions_table(){}
-        actions_table(std::shared_ptr<soci::session> session);
+        // actions go to the shard of their receiver, ABIs and accounts stay on `session`
+        actions_table(std::shared_ptr<sql_session> session, std::shared_ptr<shard_router> shards);
 
         void drop();
-        void create();
-        void add(chain::action action, chain::transaction_id_type transaction_id, fc::time_point_sec transaction_time, uint8_t seq); 
-        string add_data(chain::action );
+        // partitioned by block_num when blocks_per_partition is set, see partition_manager
+        void create( uint32_t blocks_per_partition = 0 );
+        // queues the action row; side effects (setabi, newaccount) are written right away.
+        // seq is the action's ordinal in its transaction; the trace tree position (parent is the
+        // parent's global_sequence, 0 at the top) is known only for actions written from a trace.
+        // `receiver` picks the shard: the trace's receipt receiver, the contract for a top level action
+        void add( const chain::action& action, const chain::account_name& receiver, const std::string& transaction_id_str, fc::time_point_sec transaction_time, uint32_t seq, uint32_t block_num,
+                  uint64_t global_sequence = 0, uint64_t parent = 0, uint32_t depth = 0 );
+        // writes the queued actions and their authorizations, before the block commits
+        void flush();
+        // drops what an interrupted block queued
+        void discard();
+        // JSON of the action data, in a per-thread buffer valid until the next call; fills `parties` on the way
+        const string& add_data( const chain::action&, system_contract_arg& parties, uint32_t block_num );
+
+        // SQL-free hot paths of add(), also driven by the micro benchmarks
+        static const string& decode_data( const chain::action&, const abi_version& abi, system_contract_arg& parties );
+        static system_contract_arg participants( const string& json );
+
+        void set_data_encoding( action_data_encoding encoding ) { m_data_encoding = encoding; }
+        // off for a backfill pass that runs after apply_account_effects() went over the same blocks in order
+        void set_account_effects( bool apply ) { m_account_effects = apply; }
+        // only what newaccount and setabi change outside the actions table, for an ordered pass
+        void apply_account_effects( const chain::action& action, uint32_t block_num );
 
         static const chain::account_name newaccount;
         static const chain::account_name setabi;
 
     private:
-        std::shared_ptr<soci::session> m_session;
-
-        void parse_actions(chain::action action);
+        std::shared_ptr<sql_session> m_session;
+        std::shared_ptr<shard_router> m_shards;
+        abi_history_table m_abi_history;
+        action_data_encoding m_data_encoding = action_data_encoding::json;
+        bool m_account_effects = true;
+
+        void parse_actions( const chain::action& action );
+        void apply_setabi( const chain::setabi& setabi, const chain::abi_def& abi_def, const std::string& json, uint32_t block_num );
+        // one shard's queued rows
+        struct pending_actions {
+            batched_insert actions{ "INSERT INTO actions(account, seq, created_at, name, data, data_raw, block_num, transaction_id, "
+                                    "eosto, eosfrom, receiver, payer, newaccount, sellram_account, global_sequence, parent, depth, decoded) VALUES " };
+            // actions without a global_sequence, inserted one by one for their LAST_INSERT_ID()
+            batched_insert untraced{ actions.head() };
+            batched_insert accounts{ "INSERT INTO actions_accounts(action_id, actor, permission, block_num) VALUES " };
+            // authorizations of the queued actions back to back, auth_counts[i] of them for action i
+            std::vector<chain::permission_level> auths;
+            std::vector<uint32_t> auth_counts;
+            std::vector<uint32_t> block_nums;
+            // of every queued action in add() order, 0 for the untraced ones
+            std::vector<uint64_t> global_sequences;
+        };
+
+        pending_actions& pending_for( size_t shard );
+        void add_decoded( batched_insert& rows, const chain::action& action, const std::string& transaction_id_str, int64_t expiration, uint32_t seq, uint32_t block_num );
+        void add_raw( batched_insert& rows, const chain::action& action, const std::string& transaction_id_str, int64_t expiration, uint32_t seq, uint32_t block_num );
+
+        std::vector<std::unique_ptr<pending_actions>> m_pending;
+        // ids of the traced actions just flushed, by global_sequence
+        static std::unordered_map<uint64_t, uint64_t> ids_by_global_sequence( sql_session& session, const std::vector<uint64_t>& global_sequences );
+
+        std::vector<uint64_t> m_untraced_ids;
 };
 
 
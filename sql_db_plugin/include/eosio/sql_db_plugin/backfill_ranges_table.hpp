@@ -0,0 +1,33 @@
+#pragma once
+
+#include <eosio/sql_db_plugin/table.hpp>
+
+namespace eosio {
+
+// one range of one sql_db_backfill pass
+struct backfill_range {
+    std::string pass;
+    uint32_t first = 0;
+    uint32_t last = 0;
+};
+
+/**
+ * Progress of sql_db_backfill: the last block of each range whose batch committed, written
+ * inside the same SQL transaction as the batch. A rerun skips ranges that are done and
+ * resumes the others after their last committed block.
+ */
+class backfill_ranges_table : public mysql_table {
+    public:
+        backfill_ranges_table( std::shared_ptr<sql_session> session );
+
+        void drop();
+        void create();
+        void set( const backfill_range& range, uint32_t block_num );
+        // 0 when nothing of the range was committed
+        uint32_t get( const backfill_range& range );
+
+    private:
+        std::shared_ptr<sql_session> m_session;
+};
+
+} // namespace
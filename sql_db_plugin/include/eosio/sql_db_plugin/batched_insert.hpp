@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <eosio/sql_db_plugin/sql_session.hpp>
+
+namespace eosio {
+
+/**
+ * Rows of one INSERT queued on the writer thread and sent as multi-row statements, so a
+ * block costs a few round trips instead of one per row. Text is bound as parameters and
+ * escaped by the driver; integers, blobs (as hex) and expressions are rendered into the
+ * statement. flush() runs inside the caller's transaction, which keeps commit ordering.
+ *
+ *     batched_insert b("INSERT INTO t(a, b) VALUES ");
+ *     b.row().add(name).add(42);
+ *     b.flush(session);
+ */
+class batched_insert {
+    public:
+        // `tail` follows the rows of every statement, e.g. an ON DUPLICATE KEY UPDATE clause
+        explicit batched_insert( std::string head, std::string tail = std::string(), size_t max_statement_bytes = 1 << 20 );
+
+        // starts the next row, its values follow in column order
+        batched_insert& row();
+        batched_insert& add( const std::string& text );
+        batched_insert& add_blob( const char* data, size_t size );
+        batched_insert& add_blob( const std::string& bytes ) { return add_blob( bytes.data(), bytes.size() ); }
+        batched_insert& add_null();
+        // an SQL expression, e.g. FROM_UNIXTIME(...), used as is
+        batched_insert& add_expr( const std::string& sql );
+
+        template<typename T>
+        typename std::enable_if<std::is_integral<T>::value, batched_insert&>::type add( T v ) {
+            return add_expr( std::is_signed<T>::value ? std::to_string( int64_t(v) ) : std::to_string( uint64_t(v) ) );
+        }
+
+        const std::string& head() const { return m_head; }
+        size_t size() const { return m_row_ends.size(); }
+        bool empty() const { return m_row_ends.empty(); }
+
+        // sends and clears the queued rows. A statement failed on a bad row is retried row by row,
+        // so that row costs only itself, as it did unbatched; one failed on a lost connection, lock
+        // wait or deadlock is not, see sql_session::failures. With `ids` every row is its own statement and
+        // gets its auto-increment id, 0 where it failed: the ids one multi-row INSERT takes are only
+        // consecutive under innodb_autoinc_lock_mode 0 or 1.
+        void flush( sql_session& session, std::vector<uint64_t>* ids = nullptr );
+        // drops the queued rows unsent
+        void clear();
+
+    private:
+        void close_row();
+        void separate();
+        void execute( sql_session& session, size_t first, size_t last, std::vector<uint64_t>* ids );
+        const char* row_begin( size_t i ) const { return m_values.data() + (i ? m_row_ends[i - 1] : 0); }
+
+        std::string m_head;
+        std::string m_tail;
+        size_t m_max_statement_bytes;
+        // "(:v0,2)" of every row back to back, m_row_ends[i] is the end of row i
+        std::string m_values;
+        std::vector<size_t> m_row_ends;
+        // text bound to the :v<n> placeholders, m_row_params[i] is the end of row i's
+        std::vector<std::string> m_params;
+        std::vector<size_t> m_row_params;
+        // statement bytes up to the end of row i, bound text included
+        std::vector<size_t> m_row_bytes;
+        size_t m_param_bytes = 0;
+        bool m_row_open = false;
+        std::string m_statement;
+};
+
+} // namespace
@@ -3,6 +3,7 @@
 #include <eosio/sql_db_plugin/table.hpp>
 
 #include <chrono>
+#include <vector>
 
 #include <eosio/chain/block_state.hpp>
 
@@ -10,16 +11,28 @@ namespace eosio {
 
 class blocks_table : public mysql_table {
     public:
-        blocks_table(std::shared_ptr<soci::session> session);
+        blocks_table(std::shared_ptr<sql_session> session);
 
         void drop();
         void create();
         // void add(chain::signed_block_ptr block);
-        void add( const chain::block_state_ptr& );
+        void add( const chain::block_state_ptr&, bool irreversible = false );
+        void add( const chain::signed_block_ptr&, bool irreversible );
         bool irreversible_set( std::string block_id, bool irreversible );
+        // whether the reversible writer has written the block yet
+        bool exists( const std::string& block_id );
+        // drops reversible rows of blocks that lost a fork switch; throws, the caller's transaction must not commit
+        void remove( const std::vector<std::string>& block_ids );
+
+        // head window of the reversible buffer, see reversible_block_buffer
+        void add_reversible( const chain::block_state_ptr& );
+        void remove_reversible( const std::vector<std::string>& block_ids );
+        void prune_reversible( uint32_t irreversible_block_num );
 
     private:
-        std::shared_ptr<soci::session> m_session;
+        std::shared_ptr<sql_session> m_session;
+
+        void insert( const std::string& table, const chain::signed_block_ptr&, size_t trx_count, bool irreversible );
 };
 
 } // namespace
@@ -12,24 +12,116 @@
 #include <eosio/sql_db_plugin/blocks_table.hpp>
 #include <eosio/sql_db_plugin/actions_table.hpp>
 #include <eosio/sql_db_plugin/traces_table.hpp>
+#include <eosio/sql_db_plugin/sync_state_table.hpp>
+#include <eosio/sql_db_plugin/backfill_ranges_table.hpp>
+#include <eosio/sql_db_plugin/rollups_table.hpp>
+#include <eosio/sql_db_plugin/voter_producers_table.hpp>
+#include <eosio/sql_db_plugin/reversible_block_buffer.hpp>
+#include <eosio/sql_db_plugin/partition_manager.hpp>
+#include <eosio/sql_db_plugin/shard_router.hpp>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition_variable.hpp>
 
 namespace eosio {
 
+/**
+ * Decode targets reused from one transaction to the next. Unpacking into the same
+ * chain::transaction keeps the capacity of its action and data vectors, so steady state
+ * blocks decode without allocating; reset() after a block commit gives back what an
+ * unusually large block grew.
+ */
+class block_scratch {
+    public:
+        const chain::transaction& unpack( const chain::packed_transaction& packed );
+        void reset();
+
+    private:
+        chain::transaction m_trx;
+        chain::bytes m_raw;
+};
+
+/**
+ * An irreversible block with its packed transactions unpacked ahead of the writer, by the
+ * consumer's decode stage. After prepare(), decode() may run concurrently on disjoint
+ * ranges of receipts; whatever was not decoded, the writer unpacks in place.
+ */
+struct decoded_block {
+    chain::block_state_ptr block;
+    // parallel to the block's receipts
+    std::vector<chain::transaction> trxs;
+    // set once trxs[i] holds receipt i; char rather than bool so tasks never share a byte
+    std::vector<char> decoded;
+
+    // returns the number of receipts
+    size_t prepare();
+    void decode( size_t begin, size_t end );
+    // null when receipt i was not decoded, or carries only an id
+    const chain::transaction* find( size_t i ) const;
+    // every packed receipt was decoded
+    bool complete() const;
+};
+
+/**
+ * Rows the irreversible writer waits for (the reversible block, staged traces) are written
+ * by the other stream. The reversible writer notifies after each batch; the irreversible
+ * writer re-checks on a notification or every `timeout`, until stopped. It waits before
+ * opening the block's transaction, so nothing stays locked in the meantime.
+ */
+class write_progress {
+    public:
+        void notify();
+        // false once stopped, the caller gives up on the block
+        bool wait( fc::microseconds timeout );
+        void stop();
+        bool stopped();
+
+    private:
+        boost::mutex m_mtx;
+        boost::condition_variable m_cond;
+        uint64_t m_version = 0;
+        bool m_stopped = false;
+};
+
 class database {
     public:
         database(const std::string& uri, uint32_t block_num_start);
         
         void wipe();
         bool is_started();
+        // last irreversible block whose rows were fully committed on every shard, 0 if none
+        uint32_t last_checkpoint();
+        void checkpoint( uint32_t block_num, const std::string& block_id );
+        void set_reversible_buffer( std::shared_ptr<reversible_block_buffer> buffer, bool buffer_blocks, bool mirror_head_window );
+        void set_trace_encoding( trace_encoding encoding );
+        void set_action_data_encoding( action_data_encoding encoding );
+        void set_token_schema( token_schema schema );
+        // for the irreversible writer only: partitions are maintained after each committed block
+        void set_partitioning( uint32_t blocks_per_partition, uint32_t ahead, uint32_t retain );
+        // for the irreversible writer only: account-scoped rows are spread over these servers as well
+        void set_shards( const std::vector<std::string>& uris );
         void consume_block_state( const chain::block_state_ptr& );
-        void consume_irreversible_block_state( const chain::block_state_ptr&, boost::mutex::scoped_lock&, boost::condition_variable&, boost::atomic<bool>& );
+        // false when given up on because `progress` was stopped, throws when a statement of the block
+        // failed; either way nothing of the block is committed
+        bool consume_irreversible_block_state( const decoded_block&, write_progress& );
+        // drops the queued rows and in-memory cache changes of a block that did not commit
+        void discard_pending();
 
-
-        void consume_transaction_metadata( const chain::transaction_metadata_ptr& );
         void consume_transaction_trace( const chain::transaction_trace_ptr& );
+        // `encoded` from encode_transaction_trace, so serialization can run off the writer thread
+        void consume_transaction_trace( const chain::transaction_trace_ptr&, const std::string& encoded );
+        // thread safe once configured
+        std::string encode_transaction_trace( const chain::transaction_trace& ) const;
+
+        // offline backfill: writes blocks read from blocks.log as irreversible, in one SQL transaction
+        // that also records them as the progress of `range`
+        void consume_signed_blocks( const std::vector<chain::signed_block_ptr>&, bool with_staged_traces, const backfill_range& range );
+        // offline backfill, ordered pass: only the newaccount and setabi effects of the blocks' actions
+        void consume_account_effects( const std::vector<chain::signed_block_ptr>&, const backfill_range& range );
+        // last block of `range` committed by an earlier run, 0 if none
+        uint32_t backfill_progress( const backfill_range& range );
+        // off for writers running after consume_account_effects() covered their blocks
+        void set_account_effects( bool apply );
 
         static const std::string block_states_col;
         static const std::string blocks_col;
@@ -39,12 +131,27 @@ class database {
         static const std::string accounts_col;
 
     private:
-        std::shared_ptr<soci::session> m_session;
+        void rollback( const chain::block_state_ptr& head, const std::vector<reversible_block>& dropped );
+        // until the block row (unless buffered) and the staged traces of `trx_ids` are there; false once stopped
+        bool wait_for_staged_rows( const std::string& block_id, const std::vector<std::string>& trx_ids, write_progress& progress );
+
+        std::shared_ptr<sql_session> m_session;
+        std::shared_ptr<shard_router> m_shards;
         std::unique_ptr<actions_table> m_actions_table;
         std::unique_ptr<accounts_table> m_accounts_table;
         std::unique_ptr<blocks_table> m_blocks_table;
         std::unique_ptr<transactions_table> m_transactions_table;
         std::unique_ptr<traces_table> m_traces_table;
+        std::unique_ptr<sync_state_table> m_sync_state_table;
+        std::unique_ptr<backfill_ranges_table> m_backfill_ranges;
+        std::shared_ptr<rollups_table> m_rollups;
+        std::shared_ptr<voter_producers_table> m_voter_producers;
+        std::shared_ptr<reversible_block_buffer> m_reversible_buffer;
+        // one per shard
+        std::vector<std::unique_ptr<partition_manager>> m_partitions;
+        block_scratch m_scratch;
+        bool m_buffer_blocks = false;
+        bool m_mirror_head_window = false;
         std::string system_account;
         uint32_t m_block_num_start;
     };
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <eosio/chain/trace.hpp>
+
+#include <fc/io/json.hpp>
+#include <fc/optional.hpp>
+#include <fc/reflect/reflect.hpp>
+
+namespace eosio {
+
+// types json_writer renders member by member; everything else goes through fc::variant
+template<typename T> struct json_object : std::false_type {};
+template<> struct json_object<chain::transaction_trace> : std::true_type {};
+template<> struct json_object<chain::action_trace> : std::true_type {};
+template<> struct json_object<chain::action_receipt> : std::true_type {};
+template<> struct json_object<chain::transaction_receipt_header> : std::true_type {};
+template<> struct json_object<chain::action> : std::true_type {};
+template<> struct json_object<chain::permission_level> : std::true_type {};
+
+/**
+ * Appends JSON to a caller owned buffer without building an fc::variant tree first.
+ * The output is byte for byte what fc::json::to_string produces for the same value:
+ * 64-bit integers beyond 32 bits are quoted, bytes are hex, missing optionals are null.
+ */
+class json_writer {
+    public:
+        explicit json_writer( std::string& out ) : m_out(out) {}
+
+        void write( bool v ) { m_out += v ? "true" : "false"; }
+        void write( const std::string& v );
+        void write( const chain::name& v );
+        void write( const fc::sha256& v );
+        void write( const fc::microseconds& v ) { write_int( v.count() ); }
+        void write( const fc::unsigned_int& v ) { write_uint( v.value ); }
+        void write( const std::vector<char>& v );
+        void write_null() { m_out += "null"; }
+        void write_raw( char c ) { m_out += c; }
+
+        void write_int( int64_t v );
+        void write_uint( uint64_t v );
+        // a string known to need no escaping, e.g. a name, asset or timestamp
+        void write_plain( const std::string& v );
+        void write_hex( const char* data, size_t size );
+
+        template<typename T>
+        void write( const std::vector<T>& v ) {
+            m_out += '[';
+            for( size_t i = 0; i < v.size(); ++i ) {
+                if( i ) m_out += ',';
+                write( v[i] );
+            }
+            m_out += ']';
+        }
+
+        template<typename T>
+        void write( const fc::optional<T>& v ) {
+            if( v.valid() ) write( *v );
+            else write_null();
+        }
+
+        template<typename T>
+        void write( const std::shared_ptr<T>& v ) {
+            if( v ) write( *v );
+            else write_null();
+        }
+
+        template<typename T>
+        void write( const T& v ) {
+            write_value( v, std::integral_constant<int, std::is_integral<T>::value ? 1 : json_object<T>::value ? 2 : 0>() );
+        }
+
+        // the fc::variant route, for types without a direct encoding
+        template<typename T>
+        void write_variant( const T& v ) {
+            fc::variant var;
+            fc::to_variant( v, var );
+            m_out += fc::json::to_string( var );
+        }
+
+    private:
+        template<typename T>
+        void write_value( const T& v, std::integral_constant<int, 0> ) { write_variant(v); }
+
+        template<typename T>
+        void write_value( const T& v, std::integral_constant<int, 1> ) {
+            if( std::is_signed<T>::value ) write_int( int64_t(v) );
+            else write_uint( uint64_t(v) );
+        }
+
+        template<typename T>
+        void write_value( const T& v, std::integral_constant<int, 2> ) {
+            m_out += '{';
+            bool first = true;
+            fc::reflector<T>::visit( member_visitor<T>{ *this, v, first } );
+            m_out += '}';
+        }
+
+        template<typename T>
+        struct member_visitor {
+            json_writer& writer;
+            const T& obj;
+            bool& first;
+
+            template<typename Member, class Class, Member (Class::*member)>
+            void operator()( const char* name ) const {
+                if( !first ) writer.m_out += ',';
+                first = false;
+                writer.write_plain( name );
+                writer.m_out += ':';
+                writer.write( obj.*member );
+            }
+        };
+
+        std::string& m_out;
+};
+
+} // namespace
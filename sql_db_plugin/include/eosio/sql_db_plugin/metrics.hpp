@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+#include <fc/time.hpp>
+#include <fc/variant_object.hpp>
+
+namespace eosio {
+
+/**
+ * Lock-free latency histogram in microseconds with HDR-style log-linear buckets:
+ * values below 32us are exact, above that every power of two is split into 16
+ * sub-buckets, which bounds the relative error of reported percentiles to ~6%.
+ */
+class latency_histogram {
+    public:
+        static constexpr uint32_t sub_bucket_bits = 4;
+        static constexpr uint32_t sub_bucket_count = 1 << sub_bucket_bits;
+        static constexpr uint32_t bucket_count = 64 * sub_bucket_count;
+
+        void record( uint64_t micros );
+        uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+        // value at the given quantile, 0.0 - 1.0
+        uint64_t percentile( double quantile ) const;
+        fc::variant_object report() const;
+
+    private:
+        static uint32_t bucket_index( uint64_t value );
+        static uint64_t bucket_value( uint32_t index );
+
+        std::array<std::atomic<uint64_t>, bucket_count> m_buckets{};
+        std::atomic<uint64_t> m_count{0};
+        std::atomic<uint64_t> m_sum{0};
+        std::atomic<uint64_t> m_min{UINT64_MAX};
+        std::atomic<uint64_t> m_max{0};
+};
+
+/**
+ * Process-wide registry of per-stage latency histograms, row counters and gauges.
+ * Lookups lock, so hot paths keep the returned reference in a function-local static;
+ * entries are never removed, which keeps those references valid.
+ */
+class metrics {
+    public:
+        static metrics& instance();
+
+        latency_histogram& histogram( const std::string& stage );
+        std::atomic<uint64_t>& counter( const std::string& name );
+        std::atomic<int64_t>& gauge( const std::string& name );
+
+        fc::variant_object report();
+        // logs a report when at least `interval` passed since the previous one
+        void maybe_log( fc::microseconds interval );
+
+    private:
+        struct rate_window {
+            uint64_t last_value = 0;
+            double rate = 0;
+        };
+
+        boost::mutex m_mtx;
+        std::map<std::string, std::unique_ptr<latency_histogram>> m_histograms;
+        std::map<std::string, std::unique_ptr<std::atomic<uint64_t>>> m_counters;
+        std::map<std::string, std::unique_ptr<std::atomic<int64_t>>> m_gauges;
+        std::map<std::string, rate_window> m_rates;
+        fc::time_point m_started = fc::time_point::now();
+        fc::time_point m_last_log = fc::time_point::now();
+};
+
+// records the lifetime of the scope into a histogram
+class scoped_latency {
+    public:
+        explicit scoped_latency( latency_histogram& h ) : m_histogram(h), m_start(fc::time_point::now()) {}
+        ~scoped_latency() { m_histogram.record( (fc::time_point::now() - m_start).count() ); }
+
+    private:
+        latency_histogram& m_histogram;
+        fc::time_point m_start;
+};
+
+} // namespace
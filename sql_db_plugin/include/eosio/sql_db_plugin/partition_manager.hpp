@@ -0,0 +1,47 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <eosio/sql_db_plugin/sql_session.hpp>
+
+namespace eosio {
+
+/**
+ * Keeps the block_num RANGE partitions of actions, actions_accounts and transactions
+ * ahead of the irreversible writer, so inserts land in a small partition and pmax stays
+ * empty, and drops whole partitions past the retention window instead of DELETEing rows.
+ *
+ * Partition p<N> holds blocks below N. Tables created without partitioning, or partitioned
+ * under other names, are left alone.
+ * ALTER TABLE commits implicitly, so maintain() must run outside a block's transaction.
+ */
+class partition_manager {
+    public:
+        partition_manager( std::shared_ptr<sql_session> session, uint32_t blocks_per_partition, uint32_t ahead, uint32_t retain );
+
+        // does work only when block_num crosses into a new partition
+        void maintain( uint32_t block_num );
+
+        static const std::vector<std::string> tables;
+
+    private:
+        struct partition {
+            // 0 for pmax, the MAXVALUE partition
+            uint32_t bound = 0;
+        };
+
+        // false when a partition is not a p<bound> or pmax this manager would have written
+        bool partitions( const std::string& table, std::vector<partition>& result );
+        void maintain_table( const std::string& table, uint32_t block_num );
+
+        std::shared_ptr<sql_session> m_session;
+        uint32_t m_blocks_per_partition;
+        uint32_t m_ahead;
+        uint32_t m_retain;
+        uint32_t m_next_check = 0;
+        std::set<std::string> m_unpartitioned;
+};
+
+} // namespace
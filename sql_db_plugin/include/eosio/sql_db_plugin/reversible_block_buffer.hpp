@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <eosio/chain/block_state.hpp>
+
+namespace eosio {
+
+struct reversible_block {
+    chain::block_id_type id;
+    chain::block_id_type previous;
+    uint32_t block_num = 0;
+    chain::block_state_ptr bs;
+    // transactions whose rows were produced while this block was reversible
+    std::vector<chain::transaction_id_type> trx_ids;
+};
+
+struct by_block_id;
+struct by_previous;
+struct by_block_num;
+
+typedef boost::multi_index_container<
+    reversible_block,
+    boost::multi_index::indexed_by<
+        boost::multi_index::hashed_unique< boost::multi_index::tag<by_block_id>, boost::multi_index::member<reversible_block, chain::block_id_type, &reversible_block::id>, std::hash<chain::block_id_type> >,
+        boost::multi_index::ordered_non_unique< boost::multi_index::tag<by_previous>, boost::multi_index::member<reversible_block, chain::block_id_type, &reversible_block::previous> >,
+        boost::multi_index::ordered_non_unique< boost::multi_index::tag<by_block_num>, boost::multi_index::member<reversible_block, uint32_t, &reversible_block::block_num> >
+    >
+> reversible_block_index;
+
+/**
+ * In-memory view of the reversible part of the chain, fed from accepted_block.
+ *
+ * accepted_block fires for every block applied on top of the head, so a block whose
+ * number is already present means the chain switched forks: the block previously held
+ * at that height and everything built on it are dropped and handed back to the caller.
+ * Shared by the reversible and irreversible writers, hence the internal lock.
+ */
+class reversible_block_buffer {
+    public:
+        // returns the blocks dropped from the losing branch, oldest first
+        std::vector<reversible_block> add( const chain::block_state_ptr& );
+        // forgets everything at or below the given irreversible block number
+        void prune( uint32_t irreversible_block_num );
+
+        size_t size() const;
+
+    private:
+        mutable boost::mutex m_mtx;
+        reversible_block_index m_index;
+};
+
+} // namespace
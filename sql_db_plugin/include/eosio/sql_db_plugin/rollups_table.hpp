@@ -0,0 +1,64 @@
+#pragma once
+
+#include <map>
+#include <tuple>
+
+#include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/batched_insert.hpp>
+
+#include <eosio/chain/asset.hpp>
+#include <eosio/chain/block_timestamp.hpp>
+
+namespace eosio {
+
+/**
+ * Hourly counters for the dashboards, kept up as blocks become irreversible instead of
+ * grouping blocks and actions at query time: blocks and transactions per producer, actions
+ * per contract, transfers and their volume per token. Counts accumulate in memory while a
+ * block is written and flush() adds them to the hourly rows inside the block's transaction,
+ * so a redone block is never counted twice.
+ */
+class rollups_table : public mysql_table {
+    public:
+        rollups_table( std::shared_ptr<sql_session> session );
+
+        void drop();
+        void create();
+
+        void add_block( const chain::account_name& producer, chain::block_timestamp_type time, uint32_t transactions );
+        // `time` in seconds since the epoch
+        void add_action( const chain::account_name& contract, int64_t time );
+        void add_transfer( const chain::account_name& contract, const chain::asset& quantity, int64_t time );
+
+        void flush();
+        void discard();
+
+    private:
+        struct producer_counts {
+            uint64_t blocks = 0;
+            uint64_t transactions = 0;
+        };
+        struct transfer_counts {
+            uint64_t transfers = 0;
+            // in the token's smallest unit
+            uint64_t volume = 0;
+        };
+
+        static int64_t hour_of( int64_t time ) { return time - time % 3600; }
+
+        std::shared_ptr<sql_session> m_session;
+        // keyed by name value and hour
+        std::map<std::pair<uint64_t, int64_t>, producer_counts> m_producers;
+        std::map<std::pair<uint64_t, int64_t>, uint64_t> m_contracts;
+        // keyed by contract, symbol value (precision and code) and hour
+        std::map<std::tuple<uint64_t, uint64_t, int64_t>, transfer_counts> m_transfers;
+
+        batched_insert m_producer_rows{ "INSERT INTO hourly_producers(producer, hour, blocks, transactions) VALUES ",
+            " ON DUPLICATE KEY UPDATE blocks = blocks + VALUES(blocks), transactions = transactions + VALUES(transactions)" };
+        batched_insert m_contract_rows{ "INSERT INTO hourly_contracts(contract, hour, actions) VALUES ",
+            " ON DUPLICATE KEY UPDATE actions = actions + VALUES(actions)" };
+        batched_insert m_transfer_rows{ "INSERT INTO hourly_transfers(contract, symbol, symbol_precision, hour, transfers, volume) VALUES ",
+            " ON DUPLICATE KEY UPDATE transfers = transfers + VALUES(transfers), volume = volume + VALUES(volume)" };
+};
+
+} // namespace
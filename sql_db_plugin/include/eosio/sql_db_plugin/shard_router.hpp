@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <eosio/sql_db_plugin/sync_state_table.hpp>
+
+#include <eosio/chain/types.hpp>
+
+namespace eosio {
+
+/**
+ * Spreads account-scoped rows (actions, actions_accounts, accounts_keys, tokens, stakes,
+ * refunds, votes) over several MySQL servers by a stable hash of the account name.
+ * Shard 0 is the primary and also holds every block- and transaction-scoped table.
+ *
+ * Every shard keeps its own sync_state watermark, committed with the shard's part of
+ * a block. Secondary shards commit before the primary, so the primary's checkpoint is
+ * the consistent one; a block redone after a crash between the two commits is rolled
+ * back on the shards that already have it rather than applied twice.
+ */
+class shard_router {
+    public:
+        explicit shard_router( std::shared_ptr<sql_session> primary );
+
+        // loads the shard's watermark; the shard count is part of the mapping, changing it needs a reshard
+        void add_shard( std::shared_ptr<sql_session> session );
+
+        size_t size() const { return m_shards.size(); }
+        sql_session& primary() { return *m_shards.front().session; }
+        sql_session& session( size_t shard ) { return *m_shards[shard].session; }
+        const std::shared_ptr<sql_session>& shared_session( size_t shard ) const { return m_shards[shard].session; }
+        sql_session& session_for( const chain::account_name& account ) { return session( shard_of(account) ); }
+        sql_session& session_for( const std::string& account ) { return session_for( chain::account_name(account) ); }
+        size_t shard_of( const chain::account_name& account ) const;
+
+        // lowest block committed everywhere, counting only secondaries that have committed any
+        uint32_t watermark( uint32_t primary_checkpoint ) const;
+        // failed statements of every shard's session together, see sql_session::failures
+        uint64_t failures() const;
+
+        // the secondary shards' part of one batch of blocks
+        class transaction {
+            public:
+                explicit transaction( shard_router& router );
+                // before the primary commits; shards already past block_num roll back instead
+                void commit( uint32_t block_num, const std::string& block_id );
+
+            private:
+                shard_router& m_router;
+                std::vector<std::unique_ptr<soci::transaction>> m_transactions;
+        };
+
+    private:
+        struct shard {
+            std::shared_ptr<sql_session> session;
+            std::unique_ptr<sync_state_table> sync_state;
+            uint32_t watermark = 0;
+        };
+
+        std::vector<shard> m_shards;
+};
+
+} // namespace
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+#include <soci/soci.h>
+#include <soci/version.h>
+
+#include <fc/time.hpp>
+#include <fc/variant.hpp>
+
+namespace eosio {
+
+/**
+ * Execution times of SQL statements aggregated by template, i.e. the statement text
+ * with literals, `IN (...)` lists and batched `VALUES` rows collapsed. Executions above the slow threshold
+ * are logged on their own with their bound parameters.
+ */
+class statement_stats {
+    public:
+        static statement_stats& instance();
+
+        // a zero threshold disables the slow statement log, a zero top_n the periodic report
+        void configure( fc::microseconds slow_threshold, uint32_t top_n );
+        void record( const std::string& query, uint64_t micros, const std::vector<std::string>& params, bool failed );
+
+        // templates with the largest total execution time, most expensive first
+        fc::variants top();
+        // logs the top templates when at least `interval` passed since the previous report
+        void maybe_log( fc::microseconds interval );
+
+        static std::string normalize( const std::string& query );
+
+    private:
+        struct aggregate {
+            uint64_t count = 0;
+            uint64_t failures = 0;
+            uint64_t total_us = 0;
+            uint64_t max_us = 0;
+        };
+
+        boost::mutex m_mtx;
+        std::map<std::string, aggregate> m_templates;
+        fc::microseconds m_slow_threshold = fc::milliseconds(200);
+        uint32_t m_top_n = 10;
+        fc::time_point m_last_log = fc::time_point::now();
+};
+
+/**
+ * A prepared statement timed into statement_stats around each execute(), so a loop over
+ * one statement records every execution. Elements are bound by reference: what soci::use
+ * and soci::into refer to must outlive the statement.
+ */
+class sql_session;
+
+class timed_statement {
+    public:
+        timed_statement( sql_session& session, const soci::details::prepare_temp_type& prepared, std::string query,
+                         std::vector<std::string> params );
+
+        // as soci::statement::execute, true when a row was fetched; a failure is recorded, then rethrown
+        bool execute( bool with_data_exchange = false );
+        bool fetch() { return m_statement.fetch(); }
+        long long get_affected_rows() { return m_statement.get_affected_rows(); }
+
+    private:
+        sql_session& m_session;
+        soci::statement m_statement;
+        std::string m_query;
+        std::vector<std::string> m_params;
+};
+
+/**
+ * soci::session whose statements are timed into statement_stats. Statements run through
+ * execute(), prepare_timed() or rowset() rather than `session << "..."`, so the time taken
+ * is measured around the call that runs them.
+ */
+class sql_session : public soci::session {
+    public:
+        explicit sql_session( const std::string& uri ) : soci::session(uri) {}
+
+        // runs `query` once with its soci::use and soci::into elements; true when a row was fetched
+        template<typename... Elements>
+        bool execute( const std::string& query, const Elements&... elements ) {
+            return prepare_timed( query, elements... ).execute(true);
+        }
+
+        template<typename... Elements>
+        timed_statement prepare_timed( const std::string& query, const Elements&... elements ) {
+            soci::details::prepare_temp_type prepared( prepare << query );
+            std::vector<std::string> params;
+            using expand = int[];
+            (void)expand{ 0, ( (void)( prepared, elements ), describe_element( params, elements ), 0 )... };
+            return timed_statement( *this, prepared, query, std::move(params) );
+        }
+
+        // runs `query` once with `values[0..count)` bound in order, for statements whose number of
+        // parameters is only known at run time; the driver escapes them as any soci::use
+        bool execute_values( const std::string& query, const std::string* values, size_t count );
+
+        // rows of `query`, timed up to the first one being available
+        template<typename T, typename... Elements>
+        soci::rowset<T> rowset( const std::string& query, const Elements&... elements ) {
+            soci::details::prepare_temp_type prepared( prepare << query );
+            std::vector<std::string> params;
+            using expand = int[];
+            (void)expand{ 0, ( (void)( prepared, elements ), describe_element( params, elements ), 0 )... };
+            const auto start = fc::time_point::now();
+            try {
+                soci::rowset<T> rows( prepared );
+                record( query, start, params, false );
+                return rows;
+            } catch( ... ) {
+                record( query, start, params, true );
+                throw;
+            }
+        }
+
+        void record( const std::string& query, fc::time_point start, const std::vector<std::string>& params, bool failed );
+
+        // statements that failed on this session with an error a retry can get past, including
+        // those a caller caught and logged; a duplicate key or bad value fails again and is not counted
+        uint64_t failures() const { return m_failures; }
+
+        // lost connection, lock wait timeout or deadlock
+        static bool is_transient( const std::exception& e );
+
+    private:
+        uint64_t m_failures = 0;
+
+        static std::string describe( const std::string& value );
+        template<typename T>
+        static std::string describe( const T& value ) {
+            return describe_value( value, std::is_arithmetic<T>() );
+        }
+        template<typename T>
+        static std::string describe_value( const T& value, std::true_type ) { return std::to_string(value); }
+        template<typename T>
+        static std::string describe_value( const T&, std::false_type ) { return "?"; }
+
+        // bound parameters are logged with slow statements, other elements are not described
+        template<typename T>
+        static void describe_element( std::vector<std::string>&, const T& ) {}
+#if SOCI_VERSION >= 400000
+        template<typename T>
+        static void describe_element( std::vector<std::string>& params, const soci::details::use_container<T, soci::details::no_indicator>& uc ) {
+            params.emplace_back( describe(uc.t) );
+        }
+#endif
+};
+
+} // namespace
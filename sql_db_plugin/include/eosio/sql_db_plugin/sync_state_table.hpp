@@ -0,0 +1,24 @@
+#pragma once
+
+#include <eosio/sql_db_plugin/table.hpp>
+
+namespace eosio {
+
+/**
+ * Single-row checkpoint of the last irreversible block whose rows were fully committed.
+ * Written inside the same SQL transaction as the block itself.
+ */
+class sync_state_table : public mysql_table {
+    public:
+        sync_state_table( std::shared_ptr<sql_session> session );
+
+        void drop();
+        void create();
+        void set( uint32_t block_num, const std::string& block_id );
+        uint32_t get();
+
+    private:
+        std::shared_ptr<sql_session> m_session;
+};
+
+} // namespace
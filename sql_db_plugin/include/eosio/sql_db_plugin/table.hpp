@@ -1,8 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <soci/soci.h>
 
+#include <eosio/sql_db_plugin/sql_session.hpp>
+
 #include <fc/io/json.hpp>
 #include <fc/variant.hpp>
 #include <fc/time.hpp>
@@ -16,6 +20,14 @@ class mysql_table{
 
         fc::microseconds max_serialization_time = fc::microseconds(150*1000);
 
+        // RANGE partitioning on block_num, a first partition and the catch-all pmax; empty when 0
+        static std::string partition_by_block( uint32_t blocks_per_partition ) {
+            if( blocks_per_partition == 0 ) return std::string();
+            const auto bound = std::to_string(blocks_per_partition);
+            return " PARTITION BY RANGE (`block_num`) (PARTITION p" + bound + " VALUES LESS THAN (" + bound + "),"
+                   " PARTITION pmax VALUES LESS THAN MAXVALUE)";
+        }
+
 };
 
 
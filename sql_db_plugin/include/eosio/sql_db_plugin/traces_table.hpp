@@ -1,7 +1,14 @@
 #pragma once
 
 #include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/accounts_table.hpp>
+#include <eosio/sql_db_plugin/abi_history_table.hpp>
+#include <eosio/sql_db_plugin/shard_router.hpp>
+#include <eosio/sql_db_plugin/rollups_table.hpp>
+#include <eosio/sql_db_plugin/voter_producers_table.hpp>
 
+#include <functional>
+#include <map>
 #include <vector>
 
 #include <eosio/chain/trace.hpp>
@@ -15,24 +22,131 @@ namespace eosio {
 
 using namespace std;
 
+// how staged traces are stored: JSON in `data`, or packed and compressed in `data_bin`
+enum class trace_encoding { json, binary };
+
+// how token supplies and balances are kept: `assets` and `tokens`, keyed by concatenated strings
+// with double amounts, or `token_supplies` and `token_balances`, keyed by name and symbol values
+// with amounts in the token's smallest unit
+enum class token_schema { legacy, compact };
+
+// an action applied by its own contract, with its place in the transaction's trace tree
+struct flattened_action {
+    const chain::action_trace& trace;
+    // global_sequence of the nearest applied ancestor, 0 at the top level
+    uint64_t parent;
+    uint32_t depth;
+    // pre-order position within the transaction, from 0
+    uint32_t ordinal;
+};
+
+using flattened_action_visitor = std::function<void( const flattened_action& )>;
+
 class traces_table : public mysql_table {
     public:
-        traces_table( std::shared_ptr<soci::session> session );
+        // staged traces and assets stay on `session`, account balances and stakes follow `shards`
+        traces_table( std::shared_ptr<sql_session> session, std::shared_ptr<shard_router> shards );
 
         void drop();
         void create();
         void add( const chain::transaction_trace_ptr& );
-        bool list( string, chain::block_timestamp_type );
+        // `data` as encode_staged produced it
+        void add( const chain::transaction_trace_ptr&, const std::string& data );
+        // whether the reversible writer has staged the trace yet
+        bool staged( const std::string& trace_id_str );
+        // drops traces staged for a block that lost a fork switch; one re-applied since, in a block
+        // of another number, keeps its row. Throws, the caller's transaction must not commit
+        void remove( uint32_t block_num, const std::vector<std::string>& trace_ids );
+        // applies and removes the staged trace; `elapsed` receives its execution time and `visit`
+        // sees every applied action, in the same pass that applies balance side effects
+        bool list( const string& trace_id_str, uint32_t block_num, chain::block_timestamp_type, fc::microseconds* elapsed = nullptr,
+                   const flattened_action_visitor& visit = flattened_action_visitor() );
         auto add_data(chain::action action);
-        void parse_actions( chain::action action );
-        void dfs_inline_traces( vector<chain::action_trace> itc );
+        // decoded with the ABI in effect at `block_num`
+        void parse_actions( const chain::action& action, uint32_t block_num );
+
+        // staged trace (de)serialization and traversal, kept free of SQL for the micro benchmarks
+        // encodes into a per-thread buffer that stays valid until the next call
+        static const std::string& encode( const chain::transaction_trace& );
+        static chain::transaction_trace decode( const std::string& );
+        static const std::string& encode_binary( const chain::transaction_trace& );
+        static chain::transaction_trace decode_binary( const std::string& );
+
+        // in the configured encoding, into the same per-thread buffer as encode and encode_binary
+        const std::string& encode_staged( const chain::transaction_trace& ) const;
+
+        void set_encoding( trace_encoding encoding ) { m_encoding = encoding; }
+        void set_token_schema( token_schema schema ) { m_token_schema = schema; }
+        // forgets tokens seen by a block whose transaction was rolled back
+        void discard() { m_tracked_tokens.clear(); }
+        // applied actions and transfers of listed traces are counted here
+        void set_rollups( std::shared_ptr<rollups_table> rollups ) { m_rollups = rollups; }
+        // voteproducer of listed traces is diffed into voter_producers here
+        void set_voter_producers( std::shared_ptr<voter_producers_table> voter_producers ) { m_voter_producers = voter_producers; }
+
+        /**
+         * Visits the actions applied by their own contract in pre-order, without recursion.
+         * Notifications are not visited, but inline actions a notified contract sends are, as
+         * children of the action that notified it.
+         */
+        template<typename Visitor>
+        static void for_each_flattened_action( const vector<chain::action_trace>& traces, Visitor&& visit ) {
+            struct level {
+                const vector<chain::action_trace>* traces;
+                size_t next;
+                uint64_t parent;
+                uint32_t depth;
+            };
+            std::vector<level> stack;
+            stack.reserve(8);
+            stack.push_back( level{ &traces, 0, 0, 0 } );
+            uint32_t ordinal = 0;
+            while( !stack.empty() ) {
+                auto& top = stack.back();
+                if( top.next == top.traces->size() ) {
+                    stack.pop_back();
+                    continue;
+                }
+                const auto& atc = (*top.traces)[top.next++];
+                const auto parent = top.parent;
+                const auto depth = top.depth;
+                const bool applied = atc.receipt.receiver == atc.act.account;
+                if( applied ) visit( flattened_action{ atc, parent, depth, ordinal++ } );
+                if( !atc.inline_traces.empty() ) {
+                    // invalidates `top`
+                    stack.push_back( applied ? level{ &atc.inline_traces, 0, atc.receipt.global_sequence, depth + 1 }
+                                             : level{ &atc.inline_traces, 0, parent, depth } );
+                }
+            }
+        }
+
         // void irreversible_set( std::string block_id, bool irreversible, std::string transaction_id_str );
         // bool find_transaction( std::string transaction_id_str);
 
         long long block_timestamp;
 
     private:
-        std::shared_ptr<soci::session> m_session;
+        // token_schema::compact; supplies stay on the primary, balances follow the account's shard
+        void create_token( const chain::account_name& contract, const chain::account_name& issuer, const chain::asset& maximum_supply );
+        void issue_token( const chain::account_name& contract, const chain::asset& quantity );
+        void transfer_token( const chain::account_name& contract, const chain::account_name& from, const chain::account_name& to,
+                             const chain::asset& quantity );
+        // only tokens created while the plugin followed the chain have a supply row; issues and
+        // transfers of any other token are skipped instead of recording partial balances
+        bool token_tracked( uint64_t contract, uint64_t code, uint64_t* issuer = nullptr );
+
+        std::shared_ptr<sql_session> m_session;
+        std::shared_ptr<shard_router> m_shards;
+        std::shared_ptr<rollups_table> m_rollups;
+        std::shared_ptr<voter_producers_table> m_voter_producers;
+        abi_history_table m_abi_history;
+        // staged trace text, reused so steady state reads do not allocate
+        std::string m_trace_data;
+        std::string m_trace_data_bin;
+        trace_encoding m_encoding = trace_encoding::json;
+        token_schema m_token_schema = token_schema::legacy;
+        // (contract, symbol code) -> issuer of tracked tokens
+        std::map<std::pair<uint64_t, uint64_t>, uint64_t> m_tracked_tokens;
     };
 
 } // namespace
@@ -1,22 +1,46 @@
 #pragma once
 
 #include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/batched_insert.hpp>
+#include <eosio/chain/block.hpp>
 #include <eosio/chain/transaction_metadata.hpp>
 
 namespace eosio {
 
+// what executing a transaction cost, from its block receipt and, for elapsed, its trace
+struct transaction_usage {
+    chain::transaction_receipt_header::status_enum status = chain::transaction_receipt_header::executed;
+    uint32_t cpu_usage_us = 0;
+    uint32_t net_usage_words = 0;
+    // unknown without a trace
+    fc::optional<fc::microseconds> elapsed;
+
+    explicit transaction_usage( const chain::transaction_receipt_header& receipt ):
+        status( receipt.status ), cpu_usage_us( receipt.cpu_usage_us ), net_usage_words( receipt.net_usage_words ) {}
+};
+
 class transactions_table : public mysql_table {
     public:
-        transactions_table( std::shared_ptr<soci::session> session );
+        transactions_table( std::shared_ptr<sql_session> session );
 
         void drop();
-        void create();
-        void add( chain::transaction transaction );
+        // partitioned by block_num when blocks_per_partition is set, see partition_manager
+        void create( uint32_t blocks_per_partition = 0 );
+        // queued until flush(); block_id is left '0' when empty, usage columns NULL without `usage`
+        void add( const chain::transaction& transaction, const std::string& transaction_id_str, uint32_t block_num,
+                  const std::string& block_id = std::string(), bool irreversible = false, const transaction_usage* usage = nullptr );
+        void flush();
+        void discard() { m_pending.clear(); }
         void irreversible_set( std::string block_id, bool irreversible, std::string transaction_id_str );
+        // for transactions already written, e.g. deferred ones executing in a later block
+        void irreversible_set( const std::string& block_id, uint32_t block_num, const std::string& transaction_id_str,
+                               const transaction_usage& usage );
         bool find_transaction( std::string transaction_id_str);
 
     private:
-        std::shared_ptr<soci::session> m_session;
+        std::shared_ptr<sql_session> m_session;
+        batched_insert m_pending{ "INSERT INTO transactions(id, ref_block_num, ref_block_prefix, expiration, pending, created_at, updated_at, "
+                                  "num_actions, block_num, block_id, irreversible, status, cpu_usage_us, net_usage_words, elapsed) VALUES " };
     };
 
 } // namespace
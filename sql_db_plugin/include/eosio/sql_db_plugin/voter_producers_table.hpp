@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <eosio/sql_db_plugin/table.hpp>
+#include <eosio/sql_db_plugin/batched_insert.hpp>
+#include <eosio/sql_db_plugin/shard_router.hpp>
+
+namespace eosio {
+
+/**
+ * One row per voter and producer voted for, so "who votes for X" is an index lookup instead
+ * of parsing every votes.producers blob. A vote only writes the producers that changed: the
+ * voter's set is diffed against the one cached in memory, read from the table the first time
+ * a voter is seen. A block's net change per voter is written by flush() inside the block's
+ * transaction, and committed() moves it into the cache once that transaction is durable,
+ * so a redone block diffs against what the table holds. Rows follow the voter's shard.
+ */
+class voter_producers_table : public mysql_table {
+    public:
+        voter_producers_table( std::shared_ptr<shard_router> shards );
+
+        void drop();
+        void create();
+
+        // `producers` as in voteproducer, empty when voting through a proxy
+        void vote( const chain::account_name& voter, const std::vector<chain::account_name>& producers );
+
+        void flush();
+        // after the block's transaction committed
+        void committed();
+        void discard();
+
+    private:
+        // sorted name values
+        using producer_set = std::vector<uint64_t>;
+
+        struct pending_vote {
+            producer_set before;
+            producer_set after;
+        };
+
+        struct pending_rows {
+            batched_insert inserts{ "INSERT IGNORE INTO voter_producers(voter, producer) VALUES " };
+            batched_insert deletes{ "DELETE FROM voter_producers WHERE (voter, producer) IN (", ")" };
+        };
+
+        producer_set load( const chain::account_name& voter );
+        pending_rows& rows_for( size_t shard );
+
+        std::shared_ptr<shard_router> m_shards;
+        std::unordered_map<uint64_t, producer_set> m_cache;
+        // votes of the block being written, then of the flushed block until committed()
+        std::map<uint64_t, pending_vote> m_pending;
+        std::vector<std::unique_ptr<pending_rows>> m_rows;
+};
+
+} // namespace
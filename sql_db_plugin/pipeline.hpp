@@ -0,0 +1,210 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include "work_stealing_pool.hpp"
+
+namespace eosio {
+
+/**
+ * Bounds the entries between a stream's ingest and its writer. Entries travel as tasks and
+ * handlers, the channel only counts them: acquire blocks the producer while
+ * `capacity` are in flight, which is the back pressure nodeos sees when SQL falls behind.
+ */
+class bounded_channel : public boost::noncopyable {
+    public:
+        explicit bounded_channel( size_t capacity ) : m_capacity( std::max<size_t>(capacity, 1) ) {}
+
+        // false once closed, the entry is not admitted
+        bool acquire() {
+            boost::mutex::scoped_lock lock(m_mtx);
+            while( !m_closed && m_in_flight >= m_capacity ) m_cond.wait(lock);
+            if( m_closed ) return false;
+            ++m_in_flight;
+            return true;
+        }
+
+        void release( size_t n ) {
+            {
+                boost::mutex::scoped_lock lock(m_mtx);
+                m_in_flight -= std::min(n, m_in_flight);
+            }
+            m_cond.notify_all();
+        }
+
+        void close() {
+            {
+                boost::mutex::scoped_lock lock(m_mtx);
+                m_closed = true;
+            }
+            m_cond.notify_all();
+        }
+
+        // after close, until everything admitted has been written
+        void wait_drained() {
+            boost::mutex::scoped_lock lock(m_mtx);
+            while( m_in_flight > 0 ) m_cond.wait(lock);
+        }
+
+        size_t in_flight() {
+            boost::mutex::scoped_lock lock(m_mtx);
+            return m_in_flight;
+        }
+
+        size_t capacity() const { return m_capacity; }
+
+    private:
+        const size_t m_capacity;
+        boost::mutex m_mtx;
+        boost::condition_variable m_cond;
+        size_t m_in_flight = 0;
+        bool m_closed = false;
+};
+
+/**
+ * One ordered stream of the consumer, run as stages:
+ *
+ *  - ingest: push() numbers the entry and admits it through the stream's bounded channel;
+ *  - decode: the entry is split into tasks for the work stealing pool, so one expensive
+ *    entry spreads over idle workers while others decode beside it; a completion counter
+ *    per entry releases it once its last task is done;
+ *  - aggregate: on the stream's strand, restores push order and collects every consecutive
+ *    decoded entry into one batch;
+ *  - write: the batch, still on the strand, so the writer is never run concurrently with
+ *    itself and sees entries in push order.
+ *
+ * Only the writers need a thread each; the pool size decides how much decoding overlaps them.
+ */
+template<typename Entry>
+class ordered_stream : public boost::noncopyable {
+    public:
+        // prepares the entry and returns how many decode tasks it needs, 0 for none
+        using split_fn = std::function<size_t( Entry& )>;
+        // one task; tasks of an entry run concurrently, so each must touch its own part
+        using decode_fn = std::function<void( Entry&, size_t task )>;
+        using write_fn = std::function<void( std::vector<Entry>& )>;
+
+        ordered_stream( boost::asio::io_context& io, work_stealing_pool& pool, size_t capacity,
+                        split_fn split, decode_fn decode, write_fn write ):
+            m_strand(io), m_pool(pool), m_channel(capacity),
+            m_split(std::move(split)), m_decode(std::move(decode)), m_write(std::move(write)) {}
+
+        // false when the stream is closed and the entry was dropped
+        bool push( Entry entry ) {
+            if( !m_channel.acquire() ) return false;
+            auto state = std::make_shared<pending>();
+            state->seq = m_next_seq++;
+            state->entry = std::move(entry);
+
+            size_t tasks = 0;
+            try {
+                tasks = m_split( state->entry );
+            } catch( ... ) {
+                log_decode_failure();
+            }
+            if( tasks == 0 ) {
+                decoded( state );
+                return true;
+            }
+
+            state->remaining = tasks;
+            for( size_t i = 0; i < tasks; ++i ) {
+                m_pool.submit( [this, state, i]() {
+                    try {
+                        m_decode( state->entry, i );
+                    } catch( ... ) {
+                        // the writer falls back to decoding in place
+                        log_decode_failure();
+                    }
+                    if( --state->remaining == 0 ) decoded( state );
+                });
+            }
+            return true;
+        }
+
+        // stops admitting entries; those already admitted are still written
+        void close() { m_channel.close(); }
+        void wait_drained() { m_channel.wait_drained(); }
+
+        size_t in_flight() { return m_channel.in_flight(); }
+        size_t capacity() const { return m_channel.capacity(); }
+
+    private:
+        struct pending {
+            uint64_t seq = 0;
+            Entry entry;
+            std::atomic<size_t> remaining{0};
+        };
+
+        static void log_decode_failure() {
+            try {
+                throw;
+            } catch( fc::exception& e ) {
+                wlog( "decode stage failed, ${e}", ("e", e.to_string()) );
+            } catch( std::exception& e ) {
+                wlog( "decode stage failed, ${e}", ("e", e.what()) );
+            } catch( ... ) {
+                wlog( "decode stage failed" );
+            }
+        }
+
+        void decoded( const std::shared_ptr<pending>& state ) {
+            boost::asio::post( m_strand, [this, state]() { aggregate( state->seq, std::move(state->entry) ); } );
+        }
+
+        void aggregate( uint64_t seq, Entry&& entry ) {
+            m_ready.emplace( seq, std::move(entry) );
+            m_batch.clear();
+            for( auto itr = m_ready.begin(); itr != m_ready.end() && itr->first == m_next_write; ++m_next_write ) {
+                m_batch.emplace_back( std::move(itr->second) );
+                itr = m_ready.erase(itr);
+            }
+            if( m_batch.empty() ) return;
+
+            try {
+                m_write( m_batch );
+            } catch( fc::exception& e ) {
+                elog( "FC Exception while writing ${e}", ("e", e.to_string()) );
+            } catch( std::exception& e ) {
+                elog( "STD Exception while writing ${e}", ("e", e.what()) );
+            } catch( ... ) {
+                elog( "Unknown exception while writing" );
+            }
+            m_channel.release( m_batch.size() );
+        }
+
+        boost::asio::io_context::strand m_strand;
+        work_stealing_pool& m_pool;
+        bounded_channel m_channel;
+        split_fn m_split;
+        decode_fn m_decode;
+        write_fn m_write;
+        std::atomic<uint64_t> m_next_seq{0};
+
+        // strand only
+        uint64_t m_next_write = 0;
+        std::map<uint64_t, Entry> m_ready;
+        std::vector<Entry> m_batch;
+};
+
+} // namespace
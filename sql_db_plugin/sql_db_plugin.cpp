@@ -5,9 +5,13 @@
  */
 #include <eosio/sql_db_plugin/sql_db_plugin.hpp>
 #include <eosio/sql_db_plugin/database.hpp>
+#include <eosio/sql_db_plugin/action_decoder.hpp>
 // #include "database.hpp"
 #include "consumer.hpp"
 
+#include <eosio/sql_db_plugin/metrics.hpp>
+#include <eosio/http_plugin/http_plugin.hpp>
+
 #include <fc/io/json.hpp>
 #include <fc/utf8.hpp>
 #include <fc/variant.hpp>
@@ -17,6 +21,20 @@ const char* BLOCK_START_OPTION = "sql_db-block-start";
 const char* BUFFER_SIZE_OPTION = "sql_db-queue-size";
 const char* SQL_DB_URI_OPTION = "sql_db-uri";
 const char* REBUILD_DATABASE = "rebuild-database";
+const char* REVERSIBLE_BUFFER_OPTION = "sql_db-reversible-buffer";
+const char* REVERSIBLE_TABLE_OPTION = "sql_db-reversible-table";
+const char* STATS_INTERVAL_OPTION = "sql_db-stats-interval";
+const char* SLOW_STATEMENT_OPTION = "sql_db-slow-statement-ms";
+const char* STATEMENT_TOP_OPTION = "sql_db-statement-top";
+const char* TRACE_ENCODING_OPTION = "sql_db-trace-encoding";
+const char* ACTION_DATA_OPTION = "sql_db-action-data";
+const char* TOKEN_SCHEMA_OPTION = "sql_db-token-schema";
+const char* LAZY_DECODE_BATCH_OPTION = "sql_db-lazy-decode-batch";
+const char* PARTITION_BLOCKS_OPTION = "sql_db-partition-blocks";
+const char* PARTITION_AHEAD_OPTION = "sql_db-partition-ahead";
+const char* PARTITION_RETAIN_OPTION = "sql_db-partition-retain";
+const char* SHARD_URI_OPTION = "sql_db-shard-uri";
+const char* THREADS_OPTION = "sql_db-threads";
 }
 
 namespace fc { class variant; }
@@ -31,15 +49,14 @@ namespace eosio {
             ~sql_db_plugin_impl(){};
 
             std::unique_ptr<consumer> handler;
+            std::vector<std::unique_ptr<action_decoder>> decoders;
 
             fc::optional<boost::signals2::scoped_connection> accepted_block_connection;
             fc::optional<boost::signals2::scoped_connection> irreversible_block_connection;
-            fc::optional<boost::signals2::scoped_connection> accepted_transaction_connection;
             fc::optional<boost::signals2::scoped_connection> applied_transaction_connection;
 
             void accepted_block( const chain::block_state_ptr& );
             void applied_irreversible_block( const chain::block_state_ptr& );
-            void accepted_transaction( const chain::transaction_metadata_ptr& );
             void applied_transaction( const chain::transaction_trace_ptr& );
 
     };
@@ -60,10 +77,6 @@ namespace eosio {
         handler->push_irreversible_block_state(bs);
     }
 
-    void sql_db_plugin_impl::accepted_transaction( const chain::transaction_metadata_ptr& tm ) {
-        handler->push_transaction_metadata(tm);
-    }
-
     void sql_db_plugin_impl::applied_transaction( const chain::transaction_trace_ptr& tt ) {
         
         if(tt->action_traces.size()==1&&tt->action_traces[0].act.name.to_string()=="onblock"){
@@ -82,13 +95,48 @@ namespace eosio {
 
         cfg.add_options()
                 (BUFFER_SIZE_OPTION, bpo::value<uint>()->default_value(2000),
-                "The queue size between nodeos and SQL DB plugin thread.")
+                "Entries each stream (reversible, irreversible) holds between nodeos and its SQL writer before nodeos waits.")
+                (THREADS_OPTION, bpo::value<uint32_t>()->default_value(2),
+                "Work stealing threads decoding for both streams: trace serialization and transaction unpacking, split "
+                "per block into tasks of 16 transactions. Each stream still writes in order on its own connection.")
                 (BLOCK_START_OPTION, bpo::value<uint32_t>()->default_value(0),
                 "The block to start sync.")
                 (SQL_DB_URI_OPTION, bpo::value<std::string>(),
                 "Sql DB URI connection string"
                 " If not specified then plugin is disabled. Default database 'EOS' is used if not specified in URI.")
                 (REBUILD_DATABASE,bpo::bool_switch()->default_value(false),"")
+                (REVERSIBLE_BUFFER_OPTION, bpo::bool_switch()->default_value(false),
+                "Keep reversible blocks in memory and write each block once, when it becomes irreversible.")
+                (REVERSIBLE_TABLE_OPTION, bpo::bool_switch()->default_value(false),
+                "With sql_db-reversible-buffer, mirror the reversible head window into the reversible_blocks table.")
+                (STATS_INTERVAL_OPTION, bpo::value<uint32_t>()->default_value(60),
+                "Seconds between per-stage latency and throughput reports in the log, 0 to disable. "
+                "The same report is served at /v1/sql_db/get_stats when http_plugin is enabled.")
+                (SLOW_STATEMENT_OPTION, bpo::value<uint32_t>()->default_value(200),
+                "Log every SQL statement taking at least this many milliseconds, with its bound parameters, 0 to disable.")
+                (STATEMENT_TOP_OPTION, bpo::value<uint32_t>()->default_value(10),
+                "Number of SQL statement templates, by total execution time, reported every sql_db-stats-interval, 0 to disable.")
+                (TRACE_ENCODING_OPTION, bpo::value<std::string>()->default_value("json"),
+                "How staged traces are stored until their block is irreversible: 'json' in traces.data, "
+                "or 'binary' (packed and zlib compressed) in traces.data_bin. Both are read back either way.")
+                (ACTION_DATA_OPTION, bpo::value<std::string>()->default_value("json"),
+                "How action payloads are written: 'json' decodes them into actions.data on insert, "
+                "'raw' stores the bytes in actions.data_raw and leaves decoding to the background decoder.")
+                (TOKEN_SCHEMA_OPTION, bpo::value<std::string>()->default_value("legacy"),
+                "How token supplies and balances are kept: 'legacy' in assets and tokens, or 'compact' in token_supplies "
+                "and token_balances, keyed by contract, symbol code and account values with amounts in the token's smallest unit.")
+                (LAZY_DECODE_BATCH_OPTION, bpo::value<uint32_t>()->default_value(500),
+                "Rows per batch of the background decoder filling actions.data from data_raw, 0 to disable it.")
+                (PARTITION_BLOCKS_OPTION, bpo::value<uint32_t>()->default_value(0),
+                "Blocks per partition of actions, actions_accounts and transactions when they are RANGE partitioned by block_num "
+                "(172800 is about a day). Upcoming partitions are created as blocks become irreversible, 0 to disable.")
+                (PARTITION_AHEAD_OPTION, bpo::value<uint32_t>()->default_value(2),
+                "Partitions kept created beyond the one receiving irreversible blocks.")
+                (PARTITION_RETAIN_OPTION, bpo::value<uint32_t>()->default_value(0),
+                "Partitions kept, counting the current one; older ones are dropped. 0 keeps all history.")
+                (SHARD_URI_OPTION, bpo::value<std::vector<std::string>>()->composing(),
+                "Additional SQL DB URI, may be repeated. Account-scoped rows (actions, balances, stakes, votes, keys) are spread "
+                "over sql_db-uri and these by a hash of the account; changing the list requires a reshard.")
                 ;
     }
 
@@ -101,6 +149,9 @@ namespace eosio {
             return;
         }
 
+        statement_stats::instance().configure( fc::milliseconds( options.at(SLOW_STATEMENT_OPTION).as<uint32_t>() ),
+                                               options.at(STATEMENT_TOP_OPTION).as<uint32_t>() );
+
         ilog("connecting to ${u}", ("u", uri_str));
         uint32_t block_num_start = options.at(BLOCK_START_OPTION).as<uint32_t>();
         auto queue_size = options.at(BUFFER_SIZE_OPTION).as<uint32_t>();
@@ -115,7 +166,69 @@ namespace eosio {
             }
         }
 
-        my->handler = std::make_unique<consumer>(std::move(db),std::move(db2),queue_size);
+        // the buffer tracks reversible rows for fork rollback; with REVERSIBLE_BUFFER_OPTION it also defers block writes
+        bool buffer_blocks = options.at(REVERSIBLE_BUFFER_OPTION).as<bool>();
+        bool mirror_head_window = buffer_blocks && options.at(REVERSIBLE_TABLE_OPTION).as<bool>();
+        if( buffer_blocks ) {
+            ilog("reversible blocks are buffered in memory${t}", ("t", mirror_head_window ? ", head window mirrored to reversible_blocks" : ""));
+        }
+        auto reversible_buffer = std::make_shared<reversible_block_buffer>();
+        db->set_reversible_buffer(reversible_buffer, buffer_blocks, mirror_head_window);
+        db2->set_reversible_buffer(reversible_buffer, buffer_blocks, mirror_head_window);
+
+        const auto encoding = options.at(TRACE_ENCODING_OPTION).as<std::string>();
+        FC_ASSERT( encoding == "json" || encoding == "binary", "${o} must be 'json' or 'binary'", ("o", TRACE_ENCODING_OPTION) );
+        db->set_trace_encoding( encoding == "binary" ? trace_encoding::binary : trace_encoding::json );
+        db2->set_trace_encoding( encoding == "binary" ? trace_encoding::binary : trace_encoding::json );
+
+        const auto action_data = options.at(ACTION_DATA_OPTION).as<std::string>();
+        FC_ASSERT( action_data == "json" || action_data == "raw", "${o} must be 'json' or 'raw'", ("o", ACTION_DATA_OPTION) );
+        db->set_action_data_encoding( action_data == "raw" ? action_data_encoding::raw : action_data_encoding::json );
+        db2->set_action_data_encoding( action_data == "raw" ? action_data_encoding::raw : action_data_encoding::json );
+
+        const auto tokens = options.at(TOKEN_SCHEMA_OPTION).as<std::string>();
+        FC_ASSERT( tokens == "legacy" || tokens == "compact", "${o} must be 'legacy' or 'compact'", ("o", TOKEN_SCHEMA_OPTION) );
+        db->set_token_schema( tokens == "compact" ? token_schema::compact : token_schema::legacy );
+        db2->set_token_schema( tokens == "compact" ? token_schema::compact : token_schema::legacy );
+
+        std::vector<std::string> shard_uris;
+        if( options.count(SHARD_URI_OPTION) ) {
+            shard_uris = options.at(SHARD_URI_OPTION).as<std::vector<std::string>>();
+            ilog("sharding account-scoped rows over ${n} servers", ("n", shard_uris.size() + 1));
+            db2->set_shards(shard_uris);
+        }
+
+        auto blocks_per_partition = options.at(PARTITION_BLOCKS_OPTION).as<uint32_t>();
+        if( blocks_per_partition > 0 ) {
+            db2->set_partitioning( blocks_per_partition, options.at(PARTITION_AHEAD_OPTION).as<uint32_t>(),
+                                   options.at(PARTITION_RETAIN_OPTION).as<uint32_t>() );
+        }
+
+        // also drains rows left raw by an earlier run, so it does not depend on the current encoding
+        auto lazy_decode_batch = options.at(LAZY_DECODE_BATCH_OPTION).as<uint32_t>();
+        if( lazy_decode_batch > 0 ) {
+            my->decoders.emplace_back( std::make_unique<action_decoder>(uri_str, uri_str, lazy_decode_batch, fc::seconds(1)) );
+            for( const auto& shard_uri : shard_uris ) {
+                my->decoders.emplace_back( std::make_unique<action_decoder>(shard_uri, uri_str, lazy_decode_batch, fc::seconds(1)) );
+            }
+        }
+
+        // the irreversible writer's view, which counts the shards
+        uint32_t checkpoint_block_num = db2->last_checkpoint();
+        if( checkpoint_block_num > 0 ) {
+            ilog("resuming after checkpoint at block ${n}", ("n", checkpoint_block_num));
+        }
+
+        auto stats_interval = fc::seconds( options.at(STATS_INTERVAL_OPTION).as<uint32_t>() );
+
+        auto threads = options.at(THREADS_OPTION).as<uint32_t>();
+
+        my->handler = std::make_unique<consumer>(std::move(db),std::move(db2),queue_size,checkpoint_block_num,stats_interval,threads);
+        // the index would silently stop advancing otherwise; the block is redone from the checkpoint on restart
+        my->handler->on_irreversible_failure = []() {
+            elog("sql_db irreversible writer halted, shutting down");
+            app().quit();
+        };
         chain_plugin* chain_plug = app().find_plugin<chain_plugin>();
         FC_ASSERT(chain_plug);
         auto& chain = chain_plug->chain();
@@ -124,10 +237,6 @@ namespace eosio {
             my->applied_transaction(tt);
         } ));
 
-        // my->accepted_transaction_connection.emplace(chain.accepted_transaction.connect([this](const chain::transaction_metadata_ptr& tm){
-            // my->accepted_transaction(tm);
-        // } ));
-
         my->accepted_block_connection.emplace(chain.accepted_block.connect([this]( const chain::block_state_ptr& bs){
             my->accepted_block(bs);
         } ));
@@ -140,14 +249,31 @@ namespace eosio {
 
     void sql_db_plugin::plugin_startup() {
         ilog("startup");
+
+        for( auto& decoder : my->decoders ) decoder->start();
+
+        auto* http = app().find_plugin<http_plugin>();
+        if( http && http->get_state() != abstract_plugin::registered ) {
+            http->add_api({
+                { std::string("/v1/sql_db/get_stats"), []( string, string, url_response_callback cb ) {
+                    try {
+                        auto report = fc::mutable_variant_object( metrics::instance().report() )
+                            ("statements", statement_stats::instance().top());
+                        cb( 200, fc::json::to_string( report ) );
+                    } catch( ... ) {
+                        http_plugin::handle_exception( "sql_db", "get_stats", "", cb );
+                    }
+                }}
+            });
+        }
     }
 
     void sql_db_plugin::plugin_shutdown() {
         ilog("shutdown");
+        for( auto& decoder : my->decoders ) decoder->stop();
         my->handler->shutdown();
         my->accepted_block_connection.reset();
         my->irreversible_block_connection.reset();
-        my->accepted_transaction_connection.reset();
         my->applied_transaction_connection.reset();
     }
 
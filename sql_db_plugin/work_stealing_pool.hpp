@@ -0,0 +1,146 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <fc/log/logger.hpp>
+
+#include <eosio/sql_db_plugin/metrics.hpp>
+
+namespace eosio {
+
+/**
+ * Fixed set of workers, each with its own task deque. A worker takes its newest task first
+ * and, when its deque is empty, steals the oldest task of another worker, so the tasks of
+ * one large block spread over every idle thread while small blocks stay on the thread that
+ * split them. Tasks submitted from outside the pool are dealt round robin.
+ *
+ * Tasks must not throw; wrap them when they can.
+ */
+class work_stealing_pool : public boost::noncopyable {
+    public:
+        using task = std::function<void()>;
+
+        explicit work_stealing_pool( uint32_t threads ) {
+            threads = std::max<uint32_t>(threads, 1);
+            for( uint32_t i = 0; i < threads; ++i ) m_queues.emplace_back( std::make_unique<worker_queue>() );
+            for( uint32_t i = 0; i < threads; ++i ) m_threads.create_thread([this, i]{ run(i); });
+        }
+
+        ~work_stealing_pool() {
+            stop();
+        }
+
+        void submit( task t ) {
+            const size_t index = current_pool() == this ? current_index() : m_next++ % m_queues.size();
+            // counted before it is visible, so a worker taking it never sees the count below it
+            {
+                boost::mutex::scoped_lock lock(m_idle_mtx);
+                ++m_pending;
+            }
+            {
+                auto& q = *m_queues[index];
+                boost::mutex::scoped_lock lock(q.mtx);
+                q.tasks.emplace_back( std::move(t) );
+            }
+            m_idle_cond.notify_one();
+        }
+
+        // runs what was submitted, then joins the workers
+        void stop() {
+            {
+                boost::mutex::scoped_lock lock(m_idle_mtx);
+                if( m_stopping ) return;
+                m_stopping = true;
+            }
+            m_idle_cond.notify_all();
+            m_threads.join_all();
+        }
+
+        size_t size() const { return m_queues.size(); }
+
+    private:
+        struct worker_queue {
+            boost::mutex mtx;
+            std::deque<task> tasks;
+        };
+
+        void run( size_t index ) {
+            current_pool() = this;
+            current_index() = index;
+            task t;
+            while( true ) {
+                if( pop_local(index, t) || steal(index, t) ) {
+                    {
+                        boost::mutex::scoped_lock lock(m_idle_mtx);
+                        --m_pending;
+                    }
+                    t();
+                    t = nullptr;
+                    continue;
+                }
+                boost::mutex::scoped_lock lock(m_idle_mtx);
+                while( m_pending == 0 && !m_stopping ) m_idle_cond.wait(lock);
+                if( m_pending == 0 && m_stopping ) break;
+            }
+            current_pool() = nullptr;
+        }
+
+        bool pop_local( size_t index, task& t ) {
+            auto& q = *m_queues[index];
+            boost::mutex::scoped_lock lock(q.mtx);
+            if( q.tasks.empty() ) return false;
+            t = std::move( q.tasks.back() );
+            q.tasks.pop_back();
+            return true;
+        }
+
+        bool steal( size_t thief, task& t ) {
+            static auto& steals = metrics::instance().counter("decode_pool.steals");
+            for( size_t i = 1; i < m_queues.size(); ++i ) {
+                auto& q = *m_queues[ (thief + i) % m_queues.size() ];
+                boost::mutex::scoped_lock lock(q.mtx);
+                if( q.tasks.empty() ) continue;
+                t = std::move( q.tasks.front() );
+                q.tasks.pop_front();
+                ++steals;
+                return true;
+            }
+            return false;
+        }
+
+        // the pool and queue of the worker running on this thread; function-local so the header
+        // can be included from more than one translation unit
+        static work_stealing_pool*& current_pool() {
+            thread_local work_stealing_pool* pool = nullptr;
+            return pool;
+        }
+        static size_t& current_index() {
+            thread_local size_t index = 0;
+            return index;
+        }
+
+        std::vector<std::unique_ptr<worker_queue>> m_queues;
+        std::atomic<size_t> m_next{0};
+        boost::mutex m_idle_mtx;
+        boost::condition_variable m_idle_cond;
+        // tasks queued and not yet taken, guarded by m_idle_mtx
+        size_t m_pending = 0;
+        bool m_stopping = false;
+        boost::thread_group m_threads;
+};
+
+} // namespace